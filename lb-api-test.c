@@ -0,0 +1,116 @@
+/* $Id$
+ *
+ * lb-api-test -- check that liblookbusy's generators start, reach and
+ *                follow their targets, and stop.
+ *
+ * Part of lookbusy; GPLv2 or later, see COPYING.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lookbusy.h"
+
+static int failed = 0;
+
+static void check(const char *what, double got, double want, double tol)
+{
+    int ok = got >= want - tol && got <= want + tol;
+
+    printf("%s %s: %.1f (want %.1f +/- %.1f)\n", ok ? "ok" : "FAIL", what,
+           got, want, tol);
+    if (!ok)
+        failed = 1;
+}
+
+/* this process's resident size in MB, as the kernel counts it */
+static double rss_mb()
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, resident = 0;
+
+    if (f != NULL) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return (double)resident * sysconf(_SC_PAGESIZE) / 1048576;
+}
+
+static lb_gen *start(struct lb_config *cfg)
+{
+    lb_gen *g;
+
+    if (lb_create(cfg, &g) != 0 || lb_start(g) != 0) {
+        printf("FAIL couldn't start generator kind %d\n", cfg->kind);
+        exit(1);
+    }
+    return g;
+}
+
+int main()
+{
+    struct lb_config cfg = { LB_CPU };
+    struct lb_stats st;
+    lb_gen *g;
+    double rss0;
+
+    cfg.threads = 1;
+    cfg.target = 30;
+    g = start(&cfg);
+    sleep(3);
+    lb_stats(g, &st);
+    check("cpu 30%", st.achieved, 30, 10);
+    lb_retarget(g, 70);
+    sleep(3);
+    lb_stats(g, &st);
+    check("cpu retargeted to 70%", st.achieved, 70, 10);
+    lb_stop(g);
+    lb_destroy(g);
+
+    cfg.kind = LB_MEM;
+    cfg.target = 32 * 1024 * 1024;
+    cfg.size = 64 * 1024 * 1024;
+    rss0 = rss_mb();
+    g = start(&cfg);
+    sleep(1);
+    lb_stats(g, &st);
+    check("mem 32MB", st.achieved / 1048576, 32, 1);
+    check("mem 32MB, by RSS", rss_mb() - rss0, 32, 2);
+    lb_retarget(g, 8 * 1024 * 1024);
+    sleep(1);
+    lb_stats(g, &st);
+    check("mem retargeted to 8MB", st.achieved / 1048576, 8, 1);
+    check("mem retargeted to 8MB, by RSS", rss_mb() - rss0, 8, 2);
+    if (lb_retarget(g, 128 * 1024 * 1024) == 0) {
+        printf("FAIL mem retarget beyond its reservation accepted\n");
+        failed = 1;
+    }
+    lb_destroy(g);
+
+    /* with host scope the buffer is a worker process's, not ours */
+    cfg.scope = LB_HOST;
+    cfg.target = 32 * 1024 * 1024;
+    rss0 = rss_mb();
+    g = start(&cfg);
+    sleep(1);
+    lb_stats(g, &st);
+    check("host mem 32MB", st.achieved / 1048576, 32, 1);
+    check("host mem, in the caller", rss_mb() - rss0, 0, 2);
+    lb_destroy(g);
+    cfg.scope = LB_THREAD;
+
+    cfg.kind = LB_DISK;
+    cfg.target = 1024 * 1024;
+    cfg.size = 8 * 1024 * 1024;
+    cfg.path = getenv("TMPDIR");
+    g = start(&cfg);
+    sleep(3);
+    lb_stats(g, &st);
+    check("disk 1MB/s", st.achieved / 1048576, 1, .25);
+    lb_stop(g);
+    lb_destroy(g);
+
+    return failed;
+}
@@ -0,0 +1,286 @@
+#!/bin/sh
+# $Id$
+#
+# lb-bench.sh -- measure how accurately lookbusy's generators hit their
+#                targets on this machine.
+#
+# Runs lookbusy against a matrix of CPU, memory and disk targets, samples
+# the host (or the relevant worker process) while it runs, and writes one
+# JSON object per case to the report, so that reports from two releases can
+# be diffed directly.  For each case:
+#
+#   mean            average achieved value once settled
+#   tracking_error  mean absolute deviation from target once settled
+#   settling_s      seconds until the 1s moving average stays within the
+#                   tolerance band for the rest of the run (null: never)
+#   overshoot       largest excursion above target, at any point
+#   overhead_pct    CPU used by lookbusy beyond the load itself: the
+#                   supervising parent for CPU cases, the worker for
+#                   memory and disk cases
+#
+# Units are percentage points of host CPU for CPU cases, percent of target
+# for memory cases, and percent of the nominal operation rate (one block
+# per --disk-sleep) for disk cases.
+#
+# With --check, a short matrix is run and the exit status reflects whether
+# every case stayed within generous limits; this is what `make check` does
+# (through LB_BENCH_MODE=check in the environment).  `make bench` runs the
+# full matrix.
+#
+# Part of lookbusy; GPLv2 or later, see COPYING.
+
+LOOKBUSY=${LOOKBUSY:-./lookbusy}
+REPORT=${LB_BENCH_REPORT:-}
+MODE=${LB_BENCH_MODE:-full}
+INTERVAL=0.2
+
+usage()
+{
+    echo "usage: $0 [ --check ] [ -b LOOKBUSY ] [ -o REPORT ]" >&2
+    exit 2
+}
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --check) MODE=check ;;
+        -b) shift; LOOKBUSY=$1 ;;
+        -o) shift; REPORT=$1 ;;
+        *) usage ;;
+    esac
+    shift
+done
+
+if [ ! -x "$LOOKBUSY" ]; then
+    echo "$0: $LOOKBUSY is not executable" >&2
+    exit 2
+fi
+if [ ! -r /proc/stat ]; then
+    echo "$0: /proc is required; skipping" >&2
+    exit 77
+fi
+
+TMPDIR=$(mktemp -d "${TMPDIR:-/tmp}/lb-bench.XXXXXX") || exit 1
+trap 'rm -rf "$TMPDIR"' 0
+trap 'exit 1' 1 2 15
+[ -n "$REPORT" ] || REPORT=$TMPDIR/report.json
+: > "$REPORT"
+
+NCPUS=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+HZ=$(getconf CLK_TCK 2>/dev/null || echo 100)
+VERSION=$("$LOOKBUSY" -V | sed -n '1s/^lookbusy \([^ ]*\).*/\1/p')
+FAILED=0
+
+now()
+{
+    date +%s.%N
+}
+
+# utime+stime of a process, in ticks
+proc_cpu()
+{
+    awk '{ print $14 + $15 }' "/proc/$1/stat" 2>/dev/null || echo 0
+}
+
+# the first child process of $1
+first_child()
+{
+    awk -v p="$1" '$4 == p { print $1; exit }' /proc/[0-9]*/stat 2>/dev/null
+}
+
+# sample_loop DURATION PROBE... -- run PROBE every $INTERVAL for DURATION
+# seconds, printing "elapsed value..." lines
+sample_loop()
+{
+    dur=$1
+    shift
+    start=$(now)
+    while :; do
+        t=$(now)
+        el=$(echo "$t $start" | awk '{ printf "%.3f", $1 - $2 }')
+        if awk -v e="$el" -v d="$dur" 'BEGIN { exit !(e >= d) }'; then
+            break
+        fi
+        echo "$el $("$@")"
+        sleep $INTERVAL
+    done
+}
+
+host_cpu()
+{
+    awk '/^cpu / { print $2 + $3 + $4, $2 + $3 + $4 + $5 + $6 + $7 + $8 + $9 }' \
+        /proc/stat
+}
+
+rss_bytes()
+{
+    awk '/^VmRSS:/ { print $2 * 1024 }' "/proc/$1/status" 2>/dev/null || echo 0
+}
+
+write_chars()
+{
+    awk '/^wchar:/ { print $2 }' "/proc/$1/io" 2>/dev/null || echo 0
+}
+
+# analyze GENERATOR TARGET UNIT TOLERANCE OVERHEAD < "elapsed value" lines
+#
+# Prints the case's JSON report line; exits 1 if it never settled.
+analyze()
+{
+    awk -v gen="$1" -v target="$2" -v unit="$3" -v tol="$4" \
+        -v overhead="$5" -v version="$VERSION" -v ncpus="$NCPUS" \
+        -v interval="$INTERVAL" '
+    { t[n] = $1; v[n] = $2; n++ }
+    END {
+        # 1s trailing moving average, to judge settling
+        w = int(1 / interval + 0.5); if (w < 1) w = 1
+        settle = -1
+        for (i = n - 1; i >= 0; i--) {
+            s = 0; c = 0
+            for (j = i; j >= 0 && j > i - w; j--) { s += v[j]; c++ }
+            avg = s / c
+            if (avg < target - tol || avg > target + tol)
+                break
+            settle = i
+        }
+        from = settle >= 0 ? settle : int(n / 4)
+        sum = 0; err = 0; m = 0
+        for (i = from; i < n; i++) {
+            sum += v[i]; d = v[i] - target
+            err += d < 0 ? -d : d
+            m++
+        }
+        over = 0
+        for (i = 0; i < n; i++)
+            if (v[i] - target > over) over = v[i] - target
+        mean = m ? sum / m : 0
+        terr = m ? err / m : 0
+        st = settle >= 0 ? sprintf("%.1f", t[settle]) : "null"
+        printf "{\"version\":\"%s\",\"generator\":\"%s\",\"target\":%s," \
+               "\"unit\":\"%s\",\"ncpus\":%d,\"samples\":%d," \
+               "\"mean\":%.2f,\"tracking_error\":%.2f,\"settling_s\":%s," \
+               "\"overshoot\":%.2f,\"overhead_pct\":%.2f}\n", \
+               version, gen, target, unit, ncpus, n, mean, terr, st, \
+               over, overhead
+        exit settle < 0
+    }'
+}
+
+# report LINE -- append a case to the report and summarize it
+report()
+{
+    echo "$1" >> "$REPORT"
+    echo "$1" | awk -F'[:,{}]' '{
+        for (i = 2; i < NF; i += 2) { gsub(/"/, "", $i); gsub(/"/, "", $(i+1)); f[$i] = $(i+1) }
+        printf "%-5s target %-4s %-14s mean %8s  err %6s  settle %5ss  over %6s  ovh %5s%%\n",
+               f["generator"], f["target"], f["unit"], f["mean"],
+               f["tracking_error"], f["settling_s"], f["overshoot"],
+               f["overhead_pct"]
+    }'
+}
+
+fail()
+{
+    echo "FAIL: $*" >&2
+    FAILED=1
+}
+
+# json_field LINE NAME
+json_field()
+{
+    echo "$1" | sed -n "s/.*\"$2\":\([^,}]*\).*/\1/p"
+}
+
+bench_cpu()
+{
+    target=$1 dur=$2
+    "$LOOKBUSY" -q -c "$target" -n "$NCPUS" --cpu-cache "$TMPDIR/cal" &
+    pid=$!
+    c0=$(proc_cpu $pid)
+    sample_loop "$dur" host_cpu > "$TMPDIR/raw"
+    c1=$(proc_cpu $pid)
+    kill $pid
+    wait $pid
+    ovh=$(echo "$c0 $c1 $HZ $dur" | awk '{ printf "%.2f", 100 * ($2 - $1) / $3 / $4 }')
+    line=$(awk 'NR > 1 && $3 > pt { printf "%s %.2f\n", $1, 100 * ($2 - pb) / ($3 - pt) }
+                { pb = $2; pt = $3 }' "$TMPDIR/raw" |
+           analyze cpu "$target" pct 5 "$ovh")
+    settled=$?
+    report "$line"
+    if [ "$MODE" = check ]; then
+        [ $settled -eq 0 ] || fail "CPU $target%: never settled"
+        awk -v e="$(json_field "$line" tracking_error)" 'BEGIN { exit !(e <= 10) }' ||
+            fail "CPU $target%: tracking error $(json_field "$line" tracking_error)"
+    fi
+}
+
+bench_mem()
+{
+    mb=$1 dur=$2
+    "$LOOKBUSY" -q -c 0 -m "${mb}mb" -M 100 &
+    pid=$!
+    sleep $INTERVAL
+    child=$(first_child $pid)
+    c0=$(proc_cpu "$child")
+    sample_loop "$dur" rss_bytes "$child" > "$TMPDIR/raw"
+    c1=$(proc_cpu "$child")
+    kill $pid
+    wait $pid
+    ovh=$(echo "$c0 $c1 $HZ $dur" | awk '{ printf "%.2f", 100 * ($2 - $1) / $3 / $4 }')
+    line=$(awk -v b=$((mb * 1048576)) '{ printf "%s %.2f\n", $1, 100 * $2 / b }' \
+               "$TMPDIR/raw" | analyze mem 100 pct_of_target 5 "$ovh")
+    settled=$?
+    line=$(echo "$line" | sed "s/\"target\":100/\"target\":100,\"size_mb\":$mb/")
+    report "$line"
+    if [ "$MODE" = check ] && [ $settled -ne 0 ]; then
+        fail "memory ${mb}MB: never reached target"
+    fi
+}
+
+bench_disk()
+{
+    mb=$1 sleep_ms=$2 dur=$3
+    bs=32768
+    "$LOOKBUSY" -q -c 0 -d "${mb}mb" -b $bs -D "$sleep_ms" -f "$TMPDIR" &
+    pid=$!
+    sleep $INTERVAL
+    child=$(first_child $pid)
+    c0=$(proc_cpu "$child")
+    sample_loop "$dur" write_chars "$child" > "$TMPDIR/raw"
+    c1=$(proc_cpu "$child")
+    kill $pid
+    wait $pid
+    ovh=$(echo "$c0 $c1 $HZ $dur" | awk '{ printf "%.2f", 100 * ($2 - $1) / $3 / $4 }')
+    # the nominal rate ignores the time the I/O itself takes, so some
+    # shortfall is expected; a 10% band is as close as it can reasonably get
+    line=$(awk -v bs=$bs -v nominal=$((1000 / sleep_ms)) '
+               NR > 1 && $1 > pt { printf "%s %.2f\n", $1, 100 * ($2 - pw) / bs / ($1 - pt) / nominal }
+               { pt = $1; pw = $2 }' "$TMPDIR/raw" |
+           analyze disk 100 pct_of_nominal 10 "$ovh")
+    settled=$?
+    line=$(echo "$line" | sed "s/\"target\":100/\"target\":100,\"size_mb\":$mb,\"sleep_ms\":$sleep_ms/")
+    report "$line"
+    if [ "$MODE" = check ]; then
+        awk -v m="$(json_field "$line" mean)" 'BEGIN { exit !(m >= 50) }' ||
+            fail "disk ${sleep_ms}ms: only $(json_field "$line" mean)% of nominal rate"
+    fi
+}
+
+echo "lookbusy $VERSION, $NCPUS CPU(s), $MODE run; report in $REPORT"
+if [ "$MODE" = check ]; then
+    bench_cpu 30 6
+    bench_cpu 70 6
+    bench_mem 32 4
+    bench_disk 16 20 4
+else
+    for t in 10 25 50 75 90; do
+        bench_cpu $t 20
+    done
+    for mb in 64 256 1024; do
+        bench_mem $mb 15
+    done
+    for ms in 100 10 1; do
+        bench_disk 256 $ms 15
+    done
+fi
+
+exit $FAILED
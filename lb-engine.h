@@ -0,0 +1,250 @@
+/* $Id$
+ *
+ * lb-engine.h -- the CPU, memory and disk engines in liblookbusy, and the
+ *                options and helpers they share with the lookbusy program.
+ *                Not installed; see lookbusy.h for the library's interface.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The engines run the same code whether a generator's workers are threads
+ * of an embedding program (LB_THREAD) or processes steering the host's
+ * figures (LB_HOST).  lookbusy makes its generators with lb_create() and
+ * lb_prepare(), forks and supervises their workers itself, and has each
+ * run lb_run(); the options below shape what they do, and are left at
+ * their defaults by programs which use only lookbusy.h.
+ */
+
+#ifndef LB_ENGINE_H
+#define LB_ENGINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "lookbusy.h"
+
+/* all of this is linked into embedding programs, so it's kept out of the
+ * way of their own names */
+#define say lb_say
+#define err lb_err
+#define verbosity lb_verbosity
+#define mono_nsec lb_mono_nsec
+#define timeval_usec lb_timeval_usec
+#define sleep_until_nsec lb_sleep_until_nsec
+#define rng_next lb_rng_next
+#define rng_uniform lb_rng_uniform
+#define rng_exponential lb_rng_exponential
+#define rng_sample lb_rng_sample
+#define rng_seed lb_rng_seed
+#define jiffies_to_usec lb_jiffies_to_usec
+#define get_cpu_count lb_get_cpu_count
+#define cpu_topo_load lb_cpu_topo_load
+#define cpu_place lb_cpu_place
+#define cpu_pin lb_cpu_pin
+#define get_cpu_times lb_get_cpu_times
+#define get_cpu_busy_time lb_get_cpu_busy_time
+#define parse_cpu_stat_line lb_parse_cpu_stat_line
+#define host_mem_used_kb lb_host_mem_used_kb
+#define cpu_kernels lb_cpu_kernels
+#define cpu_spin_rate lb_cpu_spin_rate
+#define cpu_spin_prepare lb_cpu_spin_prepare
+#define cpu_phase_names lb_cpu_phase_names
+#define mem_mode_names lb_mem_mode_names
+#define replay lb_replay
+#define replay_start lb_replay_start
+#define coord lb_coord
+#define coord_join lb_coord_join
+#define coord_agent lb_coord_agent
+#define sample_hook lb_sample_hook
+#define utc lb_utc
+#define c_cpu_util_mode lb_c_cpu_util_mode
+#define c_cpu_util_h lb_c_cpu_util_h
+#define c_cpu_curve_period lb_c_cpu_curve_period
+#define c_cpu_curve_peak lb_c_cpu_curve_peak
+#define c_cpu_kernel lb_c_cpu_kernel
+#define c_cpu_cache_path lb_c_cpu_cache_path
+#define c_cpu_cache lb_c_cpu_cache
+#define c_cpu_sys_pct lb_c_cpu_sys_pct
+#define c_cpu_phase lb_c_cpu_phase
+#define c_coord_weight lb_c_coord_weight
+#define c_mem_stir_sleep lb_c_mem_stir_sleep
+#define c_mem_mode lb_c_mem_mode
+#define c_mem_min lb_c_mem_min
+#define c_mem_period lb_c_mem_period
+#define mem_shape_start lb_mem_shape_start
+#define c_disk_compress lb_c_disk_compress
+#define c_disk_dedupe lb_c_disk_dedupe
+#define c_disk_share lb_c_disk_share
+#define c_disk_churn_sleep lb_c_disk_churn_sleep
+#define c_disk_churn_step_size lb_c_disk_churn_step_size
+#define c_stats_interval lb_c_stats_interval
+
+#ifdef HAVE_SYSCONF
+#define LB_PAGE_SIZE sysconf(_SC_PAGESIZE)
+#else
+#define LB_PAGE_SIZE 4096
+#endif
+
+#define PI 3.14159265358979323846
+
+#define CPU_SPIN_PERIOD 100000 /* usec; one busy/sleep control period */
+
+#define CACHE_LINE 64
+
+enum cpu_util_mode {
+    UTIL_MODE_FIXED = 0,
+    UTIL_MODE_CURVE
+};
+
+/* how far apart cooperating workers are placed, topologically */
+enum cpu_distance {
+    CPU_DIST_ANY = 0, /* unpinned */
+    CPU_DIST_SAME,    /* same logical CPU */
+    CPU_DIST_SMT,     /* SMT siblings on one core */
+    CPU_DIST_CORE,    /* different cores, same package */
+    CPU_DIST_SOCKET   /* different packages */
+};
+
+/* how sampled quantities (request CPU time, allocation size) vary */
+enum sample_dist {
+    DIST_FIXED = 0,
+    DIST_EXPONENTIAL,
+    DIST_LOGNORMAL
+};
+
+/* how spinners' busy phases line up with each other */
+enum cpu_phase {
+    CPU_PHASE_FREE = 0, /* each runs its own cycle */
+    CPU_PHASE_SYNC,     /* all burst at once */
+    CPU_PHASE_STAGGER   /* bursts spread evenly over the period */
+};
+extern const char *cpu_phase_names[];
+
+/* how the memory stirrer's resident size varies over time */
+enum mem_mode {
+    MEM_MODE_FIXED = 0,
+    MEM_MODE_RAMP,      /* from --mem-min up to -m over the period, then hold */
+    MEM_MODE_COSINE,    /* between the two, starting from --mem-min */
+    MEM_MODE_SAWTOOTH   /* leak up to -m over the period, release, repeat */
+};
+extern const char *mem_mode_names[];
+
+/* Options.  For LB_CPU, the generator's target is the floor of the curve
+ * (-c's low end); the rest apply to LB_HOST generators, and to LB_THREAD
+ * ones only where noted.
+ */
+extern int verbosity;                   /* all scopes; 0 by default */
+extern int utc;
+extern enum cpu_util_mode c_cpu_util_mode;
+extern int c_cpu_util_h;                /* percent; the curve's peak */
+extern int c_cpu_curve_period;          /* seconds */
+extern int c_cpu_curve_peak;            /* seconds after midnight */
+extern int c_cpu_kernel;                /* all scopes; into cpu_kernels[] */
+extern char *c_cpu_cache_path;          /* NULL: default location */
+extern int c_cpu_cache;                 /* all scopes */
+extern int c_cpu_sys_pct;               /* percent of busy time in kernel */
+extern enum cpu_phase c_cpu_phase;
+extern double c_coord_weight;
+extern long c_mem_stir_sleep;           /* all scopes; usec */
+extern enum mem_mode c_mem_mode;
+extern size_t c_mem_min;                /* bytes */
+extern int c_mem_period;                /* seconds */
+extern uint64_t mem_shape_start;        /* mono_nsec() the shape begins at */
+extern double c_disk_compress;          /* ratio; 0 for the plain pattern */
+extern double c_disk_dedupe;            /* ratio */
+extern int c_disk_share;                /* disk generators a replayed
+                                         * profile's I/O is split between */
+extern long c_disk_churn_sleep;         /* ms between churn iterations */
+extern size_t c_disk_churn_step_size;   /* bytes the churn's positions move
+                                         * by (the writer's twice as far) */
+extern int c_stats_interval;            /* seconds; 0 disables */
+
+/* Called by every worker once a control period or so; lookbusy reads its
+ * --perf counters from here. */
+extern void (*sample_hook)(void);
+
+int say(int level, const char *fmt, ...);
+int err(const char *fmt, ...);
+
+uint64_t mono_nsec(void);
+double timeval_usec(const struct timeval *tv);
+void sleep_until_nsec(uint64_t t);
+
+uint64_t rng_next(uint64_t *s);
+double rng_uniform(uint64_t *s);
+double rng_exponential(uint64_t *s, double mean);
+double rng_sample(uint64_t *s, enum sample_dist dist, double mean);
+uint64_t rng_seed(void);
+
+uint64_t jiffies_to_usec(uint64_t jiffies);
+int get_cpu_count(void);
+int cpu_topo_load(void);
+int cpu_place(enum cpu_distance dist, int n, int *cpus);
+void cpu_pin(const char *who, int cpu);
+void get_cpu_times(uint64_t *user, uint64_t *sys);
+uint64_t get_cpu_busy_time(void);
+int parse_cpu_stat_line(const char *s, int *cpu, uint64_t *busy,
+                        uint64_t *total);
+uint64_t host_mem_used_kb(uint64_t *avail_kb);
+
+/* the CPU kernels, and the selected one's speed in iterations/sec once
+ * cpu_spin_prepare() has established it */
+extern const struct cpu_kernel {
+    const char *name;
+    void (*fn)(uint64_t iterations);
+} cpu_kernels[];
+extern double cpu_spin_rate;
+void cpu_spin_prepare(void);
+
+/* A recorded resource profile: per-CPU utilization, memory in use and disk
+ * traffic, one sample per interval, as written by `lookbusy record` and
+ * followed by --replay.  The file is text, one sample per line, so that it
+ * can be written as it's sampled and piped, compressed or trimmed with
+ * ordinary tools:
+ *
+ *   lookbusy-profile 1 interval=1000 ncpus=2 source=host
+ *   # t_ms mem_kb rd_iops wr_iops rd_kbps wr_kbps cpu0 cpu1
+ *   0 1523400 12 40 96 1210 35 80
+ */
+#define PROFILE_VERSION 1
+#define PROFILE_MAX_CPUS 4096
+
+struct profile_sample {
+    uint64_t mem_kb;
+    uint64_t rd_iops, wr_iops;
+    uint64_t rd_kbps, wr_kbps;
+};
+
+struct profile {
+    int interval_ms;
+    int ncpus;
+    int cgroup;                 /* recorded from a cgroup, not the host */
+    size_t n;
+    struct profile_sample *s;
+    unsigned char *cpu;         /* n * ncpus, in percent of one CPU */
+};
+
+/* what LB_HOST generators follow in place of their targets, if not NULL */
+extern struct profile *replay;
+extern uint64_t replay_start;   /* mono_nsec() at which sample 0 applies */
+
+/* --coord: coord is the segment once joined.  coord_join() returns 0 or an
+ * errno value; coord_agent() is the agent process's body, and doesn't
+ * return. */
+extern struct coord_shared *coord;
+int coord_join(const char *name, double weight);
+void coord_agent(long long util_l, long long util_h, long long dummy,
+                 void *dummyp, void *dummyp2);
+
+/* Everything lb_start() does short of starting the workers.  lb_run() is
+ * then worker index's body, in whatever thread or process it's given; it
+ * returns 0 once the generator is stopped, or an errno value if the worker
+ * fails.  lb_workers() says how many there are. */
+int lb_prepare(lb_gen *gen);
+int lb_run(lb_gen *gen, int index);
+int lb_workers(lb_gen *gen);
+
+#endif /* LB_ENGINE_H */
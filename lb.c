@@ -47,6 +47,7 @@ static const char *copyright =
 #define PACKAGE "lookbusy"
 #endif
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
@@ -55,7 +56,6 @@ static const char *copyright =
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
-#define _GNU_SOURCE
 #include <getopt.h>
 #ifdef HAVE_STRING_H
 #include <string.h>
@@ -78,6 +78,38 @@ static const char *copyright =
 #include <regex.h>
 #include <stdarg.h>
 #include <math.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#endif
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#endif
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
+#if defined(HAVE_LINUX_ERRQUEUE_H) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define NET_ZEROCOPY
+#endif
+
+#include "lb-engine.h"
 
 #ifndef HAVE_STRTOL
 #define strtol(x,e,b) atol(x)
@@ -87,12 +119,6 @@ static const char *copyright =
 #define strtoll(x,e,b) atol(x)
 #endif
 
-#ifdef HAVE_SYSCONF
-#define LB_PAGE_SIZE sysconf(_SC_PAGESIZE)
-#else
-#define LB_PAGE_SIZE 4096
-#endif
-
 #ifdef _FILE_OFFSET_BITS
 #if _FILE_OFFSET_BITS == 64
 #define HAVE_LFS 1
@@ -101,65 +127,134 @@ static const char *copyright =
 #define HAVE_LFS (sizeof(off_t) >= 8)
 #endif
 
-#define PI 3.14159265358979323846
+static const char *cpu_distance_names[] = {
+    "any", "same", "smt", "core", "socket", NULL
+};
+
+enum sched_method {
+    SCHED_METHOD_PIPE = 0,
+    SCHED_METHOD_EVENTFD,
+    SCHED_METHOD_FUTEX
+};
+static const char *sched_method_names[] = {
+    "pipe", "eventfd", "futex", NULL
+};
+
+enum contend_op {
+    CONTEND_ATOMIC = 0,
+    CONTEND_MUTEX,
+    CONTEND_RWLOCK,
+    CONTEND_FALSESHARE
+};
+static const char *contend_op_names[] = {
+    "atomic", "mutex", "rwlock", "falseshare", NULL
+};
 
-enum cpu_util_mode {
-    UTIL_MODE_FIXED = 0,
-    UTIL_MODE_CURVE
+enum req_arrival {
+    REQ_ARRIVAL_POISSON = 0,
+    REQ_ARRIVAL_BURSTY
+};
+static const char *req_arrival_names[] = {
+    "poisson", "bursty", NULL
 };
-enum cpu_util_mode c_cpu_util_mode = UTIL_MODE_FIXED;
 
-static int utc = 0;
+static const char *sample_dist_names[] = {
+    "fixed", "exponential", "lognormal", NULL
+};
 
-static int c_cpu_curve_period = 86400; /* seconds */
-static int c_cpu_curve_peak = 60 * 60 * 13; /* 1PM local time */
+enum net_proto {
+    NET_PROTO_TCP = 0,
+    NET_PROTO_UDP
+};
+static const char *net_proto_names[] = {
+    "tcp", "udp", NULL
+};
 
-static int c_cpu_util_l = 50, c_cpu_util_h = 50; /* percent */
+/* the rest of the options are in liblookbusy; see lb-engine.h */
+static int c_cpu_util_l = 50; /* percent */
 static size_t c_mem_util = 0; /* bytes */
-static long c_mem_stir_sleep = 1000; /* 1000 usec / 1 ms */
 static off_t c_disk_util = 0; /* MB */
 static char **c_disk_churn_paths;
 static size_t c_disk_churn_paths_n;
 static size_t c_disk_churn_block_size = 32 * 1024; /* bytes */
-static size_t c_disk_churn_step_size = 4 * 1024; /* bytes */
-static long c_disk_churn_sleep = 100; /* ms */
-
-static int ncpus = -1; /* autodetect */
+static int c_sched_pairs = 0;
+static long c_sched_rate = 0; /* handoffs/sec over all pairs; 0: unlimited */
+static enum sched_method c_sched_method = SCHED_METHOD_PIPE;
+static enum cpu_distance c_sched_distance = CPU_DIST_ANY;
+static int c_contend_workers = 0;
+static enum contend_op c_contend_op = CONTEND_ATOMIC;
+static enum cpu_distance c_contend_distance = CPU_DIST_ANY;
+static int c_contend_ratio = 100; /* percent of operations on shared state */
+static long c_req_rate = 0; /* requests/sec; 0 disables */
+static int c_req_workers = 0; /* 0: one per CPU */
+static enum req_arrival c_req_arrival = REQ_ARRIVAL_POISSON;
+static int c_req_burst = 4; /* rate multiplier during bursts */
+static long c_req_cpu = 1000; /* mean usec of CPU per request */
+static enum sample_dist c_req_cpu_dist = DIST_EXPONENTIAL;
+static size_t c_req_mem = 0; /* bytes touched per request */
+static size_t c_req_disk = 0; /* bytes read per request */
+static off_t c_cache_util = 0; /* bytes kept in the page cache */
+static int c_net_flows = 0;
+static enum net_proto c_net_proto = NET_PROTO_TCP;
+static off_t c_net_bandwidth = 0; /* bytes per second, over all flows */
+static long c_net_msg_rate = 0; /* messages per second, over all flows */
+static long c_net_conn_rate = 0; /* TCP connections per second */
+static size_t c_net_msg_size = 0; /* bytes; 0 for the protocol's default */
+static int c_net_zerocopy = 0;
+static int c_net_netns = 0;
+static char *c_coord_name = NULL; /* shared memory segment to coordinate in */
+static int c_churn_threads = 0; /* 0: one per CPU */
+static long c_alloc_rate = 0; /* malloc/free pairs per second */
+static size_t c_alloc_size = 256; /* mean bytes */
+static enum sample_dist c_alloc_size_dist = DIST_EXPONENTIAL;
+static long c_mmap_rate = 0; /* mmap/munmap cycles per second */
+static size_t c_mmap_size = 1024 * 1024; /* bytes */
+static long c_fault_rate = 0; /* page faults per second */
+static int c_probe = 0;
+static long c_probe_interval = 1000; /* usec */
+static int c_probe_cpu = -1; /* -1: unpinned */
+static int c_probe_fifo = 0; /* SCHED_FIFO priority; 0: normal scheduling */
+static size_t c_probe_mem = 8 * 1024 * 1024; /* pointer-chase buffer */
+static int c_probe_baseline = 5; /* seconds measured before the load */
+static int c_perf = 0; /* report hardware counters per worker */
 
-static int verbosity = 1;
-
-static char *mem_stir_buffer;
+enum restart_policy {
+    RESTART_NEVER = 0,
+    RESTART_ON_FAILURE,
+    RESTART_ALWAYS
+};
+static const char *restart_policy_names[] = {
+    "never", "on-failure", "always", NULL
+};
+static enum restart_policy c_restart = RESTART_NEVER;
+static int c_restart_limit = 5;
+static int c_shutdown_timeout = 5; /* seconds */
 
-static pid_t *cpu_pids;
-static size_t n_cpu_pids;
-static pid_t *disk_pids;
-static size_t n_disk_pids;
-static pid_t mem_pid;
+static int ncpus = -1; /* autodetect */
 
 typedef void (*spinner_fn)(long long, long long, long long, void*, void *);
 
-static int say(int level, const char *fmt, ...)
-{
-    va_list ap;
-    int r;
-
-    if (level > verbosity) return 0;
-    va_start(ap, fmt);
-    r = vprintf(fmt, ap);
-    va_end(ap);
-    return r;
-}
+/* Every forked worker, with what's needed to start it again */
+struct worker {
+    pid_t pid;          /* 0 once reaped */
+    int pidfd;          /* -1 if not open, or pidfds unsupported */
+    char *desc;
+    spinner_fn fn;
+    long long arg1, arg2, arg3;
+    void *argP, *argP2;
+    int restartable;
+    int restarts;
+};
+static struct worker *workers;
+static size_t n_workers;
 
-static int err(const char *fmt, ...)
-{
-    va_list ap;
-    int r;
+/* the supervisor's event sources, set up by supervise_init() */
+static int sup_epfd = -1;
+static int sup_sigfd = -1;
+static sigset_t sup_oldmask;
+#define SUP_EV_SIGNAL ((uint32_t)-1)
 
-    va_start(ap, fmt);
-    r = vfprintf(stderr, fmt, ap);
-    va_end(ap);
-    return r;
-}
+static int exit_status = 0;
 
 static int parse_timespan(const char *str, int *r)
 {
@@ -301,571 +396,3098 @@ static int parse_int_range(const char *str, int *start, int *end)
     return 0;
 }
 
-static void shutdown()
+static int parse_choice(const char *str, const char **names)
 {
-    if (cpu_pids != NULL) {
-        int i;
-        for (i = 0; i < n_cpu_pids; i++) {
-            if (cpu_pids[i] != 0) {
-                say(1, "killing CPU spinner %d (PID %d)\n", i, cpu_pids[i]);
-                kill(cpu_pids[i], SIGTERM);
-            }
-        }
-        free(cpu_pids);
-        cpu_pids = NULL;
-    }
-    if (mem_pid != 0) {
-        say(1, "killing mem spinner %d\n", mem_pid);
-        kill(mem_pid, SIGTERM);
-    }
-    if (mem_stir_buffer != NULL) {
-        free(mem_stir_buffer);
-        mem_stir_buffer = NULL;
-    }
-    if (disk_pids != NULL) {
-        int i;
-        for (i = 0; i < n_disk_pids; i++) {
-            if (disk_pids[i] != 0) {
-                say(1,"killing disk churner %d (PID %d)\n", i, disk_pids[i]);
-                kill(disk_pids[i], SIGTERM);
-            }
-        }
-        free(disk_pids);
-        disk_pids = NULL;
-    }
-    if (c_disk_churn_paths != NULL) {
-        size_t i;
-        for (i = 0; i < c_disk_churn_paths_n; i++) {
-            if (c_disk_churn_paths[i] != NULL) {
-                if (unlink(c_disk_churn_paths[i]) == -1 && errno != ENOENT) {
-                    perror(c_disk_churn_paths[i]);
-                }
-            }
-        }
-    }
-    exit(0);
-}
+    int i;
 
-static RETSIGTYPE sigchld_handler(int signum)
-{
-    int status;
-    pid_t which = wait(&status);
-    err("got SIGCHLD for dead child %d", which);
-    if (WIFSIGNALED(status)) {
-        err("; exited with signal %d\n", WTERMSIG(status));
-    } else {
-        err("; exited with status %d\n", WEXITSTATUS(status));
+    for (i = 0; names[i] != NULL; i++) {
+#ifdef HAVE_STRCASECMP
+        if (strcasecmp(str, names[i]) == 0)
+#else
+        if (strcmp(str, names[i]) == 0)
+#endif
+            return i;
     }
-    shutdown();
+    return -1;
 }
 
-static void sigterm_handler(int signum)
-{
-    shutdown();
-}
+/* Hardware counters, read per worker with --perf.  Each counter is opened
+ * on its own rather than as a group, so that one the PMU lacks (or a
+ * hypervisor hides) doesn't take the rest with it; multiplexing is
+ * corrected for by scaling with the enabled/running times.
+ */
+enum perf_counter {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NCOUNTERS
+};
+static const char *perf_counter_names[] = {
+    "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses"
+};
 
-static uint64_t jiffies_to_usec(uint64_t jiffies)
-{
-    return jiffies * (1000 / sysconf(_SC_CLK_TCK)) * 1000;
-}
+#define PERF_SAMPLE_PERIOD (CPU_SPIN_PERIOD * 1000ULL) /* nsec */
 
-static int get_cpu_count()
-{
-    /* FIXME: linux-specific */
-    FILE *f;
-    char s[128];
-    int n = 0;
-    static const char *pattern =
-        "^physical *id +: *0*[1-9]";
-    regex_t ex;
-    int e;
+struct perf_counters {
+    int fd[PERF_NCOUNTERS];
+    uint64_t last[PERF_NCOUNTERS];  /* scaled counts at the last sample */
+    uint64_t sum[PERF_NCOUNTERS];   /* since the last report */
+    double ipc_min, ipc_max;        /* per sample, since the last report */
+    uint64_t sample_time, report_time;
+};
 
-    if ((e = regcomp(&ex, pattern, REG_EXTENDED | REG_ICASE)) != 0) {
-        char errbuf[128];
-        regerror(e, &ex, errbuf, sizeof(errbuf)-1);
-        errbuf[sizeof(errbuf)-1] = '\0';
+static unsigned perf_available;    /* bitmask of counters which opened */
+static int perf_exclude_kernel = 0;
+static const char *perf_who;       /* this worker's description */
+static struct perf_counters perf;  /* this worker's counters */
 
-        err("regcomp(%s): %s\n", pattern, errbuf);
-        return -1;
-    }
+#ifdef HAVE_LINUX_PERF_EVENT_H
+static int perf_counter_open(enum perf_counter which)
+{
+    struct perf_event_attr attr;
 
-    f = fopen("/proc/cpuinfo", "r");
-    if (f == NULL) {
-        perror("/proc/cpuinfo");
-        exit(1);
-    }
-    while (fgets(s, sizeof(s)-1, f) != NULL) {
-        s[sizeof(s)-1] = '\0';
-        if (!strncmp(s, "processor", strlen("processor"))) {
-            n++;
-        } else {
-            e = regexec(&ex, s, 0, NULL, 0);
-            if (e == 0) {
-                /* matched a phys-id other than zero, don't count it */
-                n--;
-            } else if (e != REG_NOMATCH) {
-                char errbuf[128];
-                regerror(e, &ex, errbuf, sizeof(errbuf)-1);
-                errbuf[sizeof(errbuf)-1] = '\0';
-                err("regexec: Couldn't match '%s' in '%s': %s\n",
-                    pattern, s, errbuf);
-                return -1;
-            }
-        }
-    }
-    fclose(f);
-    if (n == 0) {
-        err("Couldn't get any CPU counts, assuming one CPU core\n");
-        err("If this is wrong, override with --ncpus\n");
-        ncpus = 1;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (which) {
+        case PERF_CYCLES:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
     }
-    return n;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = perf_exclude_kernel;
+    attr.exclude_hv = 1;
+    /* take in threads the worker starts, such as the allocation churner's;
+     * reads of the counter sum them with the thread that opened it */
+    attr.inherit = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+#else
+static int perf_counter_open(enum perf_counter which)
+{
+    errno = ENOSYS;
+    return -1;
 }
+#endif
 
-static uint64_t get_cpu_busy_time()
+/* Find out, once in the parent, which counters this host will give us, so
+ * that the workers needn't each discover and complain about the same thing.
+ * Unprivileged users usually may only count user-space events, and VMs
+ * often have no PMU at all.
+ */
+static void perf_probe()
 {
-    FILE *f;
-    char s[256];
-    uint64_t utime, ntime, stime;
-    static regex_t *ex = NULL;
-    static const char *pattern =
-        "^cpu[[:space:]]+([0-9]+)[[:space:]]+([0-9]+)[[:space:]]+([0-9]+)";
-    int r;
+    int i, fd, e = 0;
 
-    if (ex == NULL) {
-        ex = (regex_t *)malloc(sizeof(*ex));
-        if (ex == NULL) {
-            perror("malloc");
-            _exit(1);
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        fd = perf_counter_open((enum perf_counter)i);
+        if (fd == -1 && (errno == EACCES || errno == EPERM) &&
+            ! perf_exclude_kernel) {
+            perf_exclude_kernel = 1;
+            fd = perf_counter_open((enum perf_counter)i);
         }
-        if ((r = regcomp(ex,pattern, REG_EXTENDED)) != 0) {
-            char errbuf[128];
-            regerror(r, ex, errbuf, sizeof(errbuf)-1);
-            errbuf[sizeof(errbuf)-1] = '\0';
-
-            err("regcomp(%s): %s\n", pattern, errbuf);
-            _exit(1);
+        if (fd == -1) {
+            e = errno;
+            say(2, "perf (%d): %s unavailable: %s\n", getpid(),
+                   perf_counter_names[i], strerror(e));
+            continue;
         }
+        perf_available |= 1U << i;
+        close(fd);
     }
-
-    if ((f = fopen("/proc/stat", "r")) == NULL) {
-        perror("/proc/stat");
-        _exit(1);
-    }
-    if (fgets(s, sizeof(s)-1, f) == NULL) {
-        perror("fgets");
-        _exit(1);
+    if (perf_available == 0) {
+        err("Hardware performance counters are unavailable (%s); continuing"
+            " without them\n", strerror(e));
+    } else if (perf_exclude_kernel) {
+        say(1, "perf (%d): counting user-space events only (see"
+               " perf_event_paranoid)\n", getpid());
     }
+}
 
-    regmatch_t matches[4];
-    if ((r = regexec(ex, s, 4, matches, 0)) != 0) {
-        char errbuf[128];
-        regerror(r, ex, errbuf, sizeof(errbuf)-1);
-        errbuf[sizeof(errbuf)-1] = '\0';
+/* open this worker's counters; called in the worker, after forking */
+static void perf_open(const char *who)
+{
+    int i;
 
-        err("regexec: Couldn't match '%s' in '%s': %s\n", pattern, s, errbuf);
-        _exit(1);
+    perf_who = who;
+    memset(&perf, 0, sizeof(perf));
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        perf.fd[i] = -1;
+        if (! (perf_available & (1U << i)))
+            continue;
+        if ((perf.fd[i] = perf_counter_open((enum perf_counter)i)) == -1)
+            say(2, "perf (%d): %s: couldn't open %s: %s\n", getpid(), who,
+                   perf_counter_names[i], strerror(errno));
     }
+    perf.sample_time = perf.report_time = mono_nsec();
+}
 
-    utime = atol(s + matches[1].rm_so);
-    ntime = atol(s + matches[2].rm_so);
-    stime = atol(s + matches[3].rm_so);
+static int perf_read(int fd, uint64_t *value)
+{
+    uint64_t v[3]; /* value, time enabled, time running */
 
-    say(3, "cpu_spin(%d): current utime=%"PRIu64
-           " ntime=%"PRIu64" stime=%"PRIu64" total=%"PRIu64"\n",
-            getpid(), utime, ntime, stime, utime + ntime + stime);
-    fclose(f);
-    return utime + ntime + stime;
+    /* not scheduled onto the PMU at all yet, if multiplexed */
+    if (fd == -1 || read(fd, v, sizeof(v)) != sizeof(v) || v[2] == 0)
+        return -1;
+    if (v[2] < v[1])
+        *value = (uint64_t)((double)v[0] * v[1] / v[2]);
+    else
+        *value = v[0];
+    return 0;
 }
 
-static char cpu_spin_accumulator;
-
-static char squander_time(uint64_t iteration)
+static void perf_report(uint64_t now)
 {
-    return (cpu_spin_accumulator += (char)iteration);
+    char buf[512];
+    size_t n = 0;
+    double secs = (now - perf.report_time) / 1e9;
+    double kinstr = perf.sum[PERF_INSTRUCTIONS] / 1e3;
+    int i;
+
+    if (perf.fd[PERF_CYCLES] != -1)
+        n += snprintf(buf + n, sizeof(buf) - n, ", %.1fM cycles/sec",
+                      perf.sum[PERF_CYCLES] / secs / 1e6);
+    if (perf.fd[PERF_CYCLES] != -1 && perf.fd[PERF_INSTRUCTIONS] != -1 &&
+        perf.sum[PERF_CYCLES] > 0)
+        n += snprintf(buf + n, sizeof(buf) - n, ", IPC %.2f (%.2f-%.2f)",
+                      (double)perf.sum[PERF_INSTRUCTIONS] /
+                      perf.sum[PERF_CYCLES], perf.ipc_min, perf.ipc_max);
+    else if (perf.fd[PERF_INSTRUCTIONS] != -1)
+        n += snprintf(buf + n, sizeof(buf) - n, ", %.1fM instructions/sec",
+                      perf.sum[PERF_INSTRUCTIONS] / secs / 1e6);
+    /* misses are per thousand instructions when there's a count to divide
+     * by, so that profiles from differently-sized loads compare */
+    for (i = PERF_LLC_MISSES; i <= PERF_BRANCH_MISSES; i++) {
+        if (perf.fd[i] == -1 || n >= sizeof(buf))
+            continue;
+        if (perf.fd[PERF_INSTRUCTIONS] != -1 && kinstr > 0)
+            n += snprintf(buf + n, sizeof(buf) - n, ", %.3f %s/kinstr",
+                          perf.sum[i] / kinstr, perf_counter_names[i]);
+        else
+            n += snprintf(buf + n, sizeof(buf) - n, ", %.0f %s/sec",
+                          perf.sum[i] / secs, perf_counter_names[i]);
+    }
+    if (n == 0 || n >= sizeof(buf))
+        return;
+    say(1, "perf (%d): %s:%s\n", getpid(), perf_who, buf + 1);
 }
 
-static void cpu_spin_calibrate(int util, uint64_t *busycount, suseconds_t *sleeptime)
+/* Called from each worker's loop; reads the counters at most once per
+ * control period, and reports every --stats-interval.
+ */
+static void perf_sample()
 {
-    uint64_t counter;
-    struct timeval tv, tv2;
-    const uint64_t iterations = 10000000;
+    uint64_t now, delta[PERF_NCOUNTERS];
+    int i, valid[PERF_NCOUNTERS];
 
-    say(1, "cpu_spin (%d): measuring CPU\n", getpid());
-    if (gettimeofday(&tv, NULL) == -1) shutdown();
-    for (counter = 0; counter < iterations; counter++) {
-        squander_time(counter);
-    }
-    if (gettimeofday(&tv2, NULL) == -1) shutdown();
-    long long elapsed = (tv2.tv_sec - tv.tv_sec) * 1000000 +
-                    (tv2.tv_usec - tv.tv_usec);
-    long long countspeed = (counter * 100000)/elapsed;
-    *busycount = (countspeed * util) / 100LL;
-    /* busy_count_time = busycount/(counter/elapsed)
-     * idle_time = 1sec - busy_count_time
-     */
+    if (perf_who == NULL)
+        return;
+    now = mono_nsec();
+    if (now - perf.sample_time < PERF_SAMPLE_PERIOD)
+        return;
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        uint64_t v;
 
-    *sleeptime = 100000 - *busycount / (counter / elapsed);
-    say(3, "cpu_spin (%d): %"PRIu64" iterations in %lld usec (%lld/sec)\n",
-           getpid(), counter, elapsed, countspeed);
+        /* A failed read skips the sample; a scaled estimate can come out
+         * below the last one, which counts as nothing having happened. */
+        delta[i] = 0;
+        valid[i] = perf_read(perf.fd[i], &v) == 0;
+        if (!valid[i])
+            continue;
+        if (v > perf.last[i])
+            delta[i] = v - perf.last[i];
+        perf.last[i] = v;
+        perf.sum[i] += delta[i];
+    }
+    if (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] &&
+        delta[PERF_CYCLES] > 0) {
+        double ipc = (double)delta[PERF_INSTRUCTIONS] / delta[PERF_CYCLES];
+        if (perf.ipc_max == 0 || ipc < perf.ipc_min)
+            perf.ipc_min = ipc;
+        if (ipc > perf.ipc_max)
+            perf.ipc_max = ipc;
+    }
+    perf.sample_time = now;
 
-    say(1, "cpu_spin (%d): est. %d%% util at %"PRIu64" cycles, %u usec sleep\n",
-            getpid(), util, *busycount, *sleeptime);
+    if (c_stats_interval > 0 &&
+        now - perf.report_time >= (uint64_t)c_stats_interval * 1000000000) {
+        perf_report(now);
+        memset(perf.sum, 0, sizeof(perf.sum));
+        perf.ipc_min = perf.ipc_max = 0;
+        perf.report_time = now;
+    }
 }
 
-static double cpu_spin_compute_util(enum cpu_util_mode mode, int l, int h,
-                                    time_t curtime)
+static const char *worker_fate(int status, char *buf, size_t sz)
 {
-    static long time_offset = -1;
-
-    if (time_offset == -1) {
-        if (!utc) {
-#ifdef HAVE_TZSET
-            tzset();
+    if (WIFSIGNALED(status))
+        snprintf(buf, sz, "was killed by signal %d (%s)%s", WTERMSIG(status),
+                 strsignal(WTERMSIG(status)),
+#ifdef WCOREDUMP
+                 WCOREDUMP(status) ? ", dumping core" :
 #endif
-            time_offset = -timezone;
-        } else {
-            time_offset = 0;
-        }
-        time_offset += c_cpu_curve_peak;
-    }
-
-    if (mode == UTIL_MODE_FIXED) return l;
-    if (mode == UTIL_MODE_CURVE) {
-        if (curtime == 0)
-            curtime = time(NULL);
-        long offset_in_interval = (curtime + time_offset) % c_cpu_curve_period;
-        double fraction = (double)offset_in_interval / (double)c_cpu_curve_period;
-        /* model the CPU usage as a cosine function over [0,2pi], shifted up
-         * by min+1 to place the floor on min, and scaled so as to have its
-         * entire range between min and max.  That is, the peak of the cosine
-         * curve is placed at X=0, and it oscillates over the selected CPU
-         * utilization range.
-         *
-         * This isn't a particularly realistic utilization curve and something
-         * better ought to be found.  Or just bite the bullet and make it
-         * data-driven.
-         */
-        double level = (double)l +
-            (double)(h - l) * (cos(fraction * PI * 2) + 1)/2;
-        return level;
-    }
-    /* shouldn't get here */
-    return -1;
+                 "");
+    else
+        snprintf(buf, sz, "exited with status %d", WEXITSTATUS(status));
+    return buf;
 }
 
-static void cpu_spin(long long ncpus, long long util_l, long long util_h, void *dummy, void *dummy2)
+static struct worker *worker_reaped(pid_t pid)
 {
-    uint64_t busycount;
-    const uint64_t minimum_cycles = 10000;
-    suseconds_t sleeptime;
-    int first = 1;
-    double util;
-    int64_t adjust = 0;
-        
-    util = cpu_spin_compute_util(c_cpu_util_mode, util_l, util_h, 0);
-
-    cpu_spin_calibrate(util, &busycount, &sleeptime);
-
-    say(2, "cpu_spin (%d): spinning cpu\n", getpid());
-    while (1) {
-        struct timeval tv;
-        long long counter;
-        uint64_t busytime, busytime2;
-        uint64_t walltime, walltime2;
-
-        if (! first) {
-            uint64_t busy = jiffies_to_usec(busytime2 - busytime) / ncpus;
-            uint64_t wall = walltime2 - walltime;
-            double actual = (100 * busy) / wall;
-            int64_t oldadjust = adjust;
-            /* On a multi-CPU system there will be more than one spinner
-             * trying to hit the target utilization, so restrain the
-             * adjustment range so as to keep from collectively
-             * overcompensating
-             */
-            adjust = (int64_t)(((util - actual) * busycount) / 100. / ncpus);
-            say(3, "cpu_spin (%d): last iter: count=%lld"
-                   " (~%lld of %lld); adjust=%lld\n",
-                   getpid(), busycount, busy, wall, 
-                   adjust);
-            if (adjust < 0 && busycount < -adjust) {
-                say(2, "cpu_spin (%d): usage at lower limit\n", getpid());
-                busycount = minimum_cycles;
-            } else if (adjust > 0 && UINT64_MAX - adjust < busycount) {
-                say(2, "cpu_spin (%d): usage at upper limit\n", getpid());
-            } else {
-                busycount += adjust;
-                if (busycount < minimum_cycles)
-                    busycount = minimum_cycles;
-            }
+    size_t i;
 
-            if ((adjust < 0 && oldadjust > 0) ||
-                (adjust > 0 && oldadjust < 0)) {
-                say(3, "cpu_spin (%d): adjusted approximately correctly\n",
-                       getpid());
-                say(3, "cpu_spin (%d): spin count %"PRIu64"\n", getpid(), busycount);
+    for (i = 0; i < n_workers; i++) {
+        if (workers[i].pid == pid) {
+            workers[i].pid = 0;
+            if (workers[i].pidfd != -1) {
+                close(workers[i].pidfd); /* also leaves the epoll set */
+                workers[i].pidfd = -1;
             }
-        } else {
-            first = 0;
-        }
-        gettimeofday(&tv, NULL);
-        walltime = tv.tv_sec * 1000000 + tv.tv_usec;
-        busytime = get_cpu_busy_time();
-
-        say(3, "cpu_spin (%d): spinning (0 to %"PRIu64")...\n", getpid(), busycount);
-        for (counter = 0; counter < busycount; counter++) {
-            squander_time(counter);
+            return &workers[i];
         }
-
-        say(3, "cpu_spin (%d): sleeping...\n", getpid());
-        usleep(sleeptime);
-        gettimeofday(&tv, NULL);
-        walltime2 = tv.tv_sec * 1000000 + tv.tv_usec;
-        busytime2 = get_cpu_busy_time();
-
-        util = cpu_spin_compute_util(c_cpu_util_mode, util_l, util_h, tv.tv_sec);
-
-        /* "elapsed" here doesn't necessarily refer only to our own usage */
-        say(2, "cpu_spin (%d): %"PRIu64" iterations; %"PRIu64" CPU-jiffies elapsed\n",
-               getpid(), counter, busytime2-busytime,
-               ncpus);
     }
-    _exit(1);
+    return NULL;
 }
 
-static void mem_stir(long long asz, long long dummy, long long dummy2, void *dummyp, void *dummyp2)
+/* Read and discard pending signals; returns nonzero if any of them asked
+ * us to terminate. */
+static int supervise_drain_signals()
 {
-    char *mem_stir_buffer;
-    char *p;
-    const size_t pagesize = LB_PAGE_SIZE;
-    const size_t sz = asz;
+    struct signalfd_siginfo si;
+    int term = 0;
 
-    say(1, "mem_stir (%d): stirring %llu bytes...\n", getpid(), sz);
-    if ((mem_stir_buffer = (char *)malloc(sz)) == NULL) {
-        perror("malloc");
-        _exit(1);
+    if (sup_sigfd == -1)
+        return 0;
+    while (read(sup_sigfd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGTERM || si.ssi_signo == SIGINT)
+            term = si.ssi_signo;
     }
+    return term;
+}
 
-    say(2, "mem_stir (%d): dirtying buffer...", getpid());
-    for (p = mem_stir_buffer; p < mem_stir_buffer + sz; p++) {
-        *p = (char)((uintptr_t)p & 0xff);
-    }
-    say(2, "done\n");
+/* Stop all workers in parallel: SIGTERM to everyone at once, then wait up
+ * to --shutdown-timeout for them to go before resorting to SIGKILL.  A
+ * further SIGTERM or SIGINT while waiting cuts the wait short.
+ */
+static void shut_down()
+{
+    size_t i, live = 0;
+    uint64_t deadline;
+    char fate[128];
 
-    char *sp = mem_stir_buffer;
-    char *dp = mem_stir_buffer;
-    while (1) {
-        const size_t copysz = pagesize;
+    for (i = 0; i < n_workers; i++) {
+        if (workers[i].pid != 0) {
+            say(1, "killing %s (PID %d)\n", workers[i].desc, workers[i].pid);
+            kill(workers[i].pid, SIGTERM);
+            live++;
+        }
+    }
+    deadline = mono_nsec() + (uint64_t)c_shutdown_timeout * 1000000000;
+    while (live > 0) {
+        uint64_t now = mono_nsec();
+        struct epoll_event ev[64];
+        int status;
+        pid_t pid;
 
-#ifdef HAVE_MEMMOVE
-        memmove(dp, sp, copysz);
-#else
-        memcpy(dp, sp, copysz);
-#endif
-        sp += pagesize * 1;
-        dp += pagesize * 5;
-        if (sp >= mem_stir_buffer + sz) {
-            say(2, "mem_stir (%d): read position wrapped\n", getpid());
-            sp = mem_stir_buffer;
+        if (now >= deadline) {
+            for (i = 0; i < n_workers; i++) {
+                if (workers[i].pid != 0) {
+                    err("%s (PID %d) still running after %ds; sending SIGKILL\n",
+                        workers[i].desc, workers[i].pid, c_shutdown_timeout);
+                    kill(workers[i].pid, SIGKILL);
+                }
+            }
+            while (live > 0 && (pid = waitpid(-1, &status, 0)) > 0) {
+                if (worker_reaped(pid) != NULL)
+                    live--;
+            }
+            break;
+        }
+        if (sup_epfd != -1) {
+            if (epoll_wait(sup_epfd, ev, 64,
+                           (int)((deadline - now) / 1000000) + 1) > 0 &&
+                supervise_drain_signals())
+                deadline = now;
+        } else {
+            usleep(10000);
         }
-        if (dp >= mem_stir_buffer + sz) {
-            say(2, "mem_stir (%d): write position wrapped\n", getpid());
-            dp = mem_stir_buffer;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            struct worker *w = worker_reaped(pid);
+            if (w == NULL)
+                continue;
+            live--;
+            say(2, "%s (PID %d) %s\n", w->desc, pid,
+                   worker_fate(status, fate, sizeof(fate)));
         }
-        usleep(c_mem_stir_sleep);
+        if (pid == -1 && errno == ECHILD)
+            break;
     }
-    _exit(1);
+    if (c_disk_churn_paths != NULL) {
+        size_t i;
+        for (i = 0; i < c_disk_churn_paths_n; i++) {
+            if (c_disk_churn_paths[i] != NULL) {
+                if (unlink(c_disk_churn_paths[i]) == -1 && errno != ENOENT) {
+                    perror(c_disk_churn_paths[i]);
+                }
+            }
+        }
+    }
+    exit(exit_status);
 }
 
-static void disk_churn(long long dummy0, long long dummy, long long dummy2, void *pathv, void *szv)
+static char *c_replay_path;
+
+static struct profile *profile_load(const char *path)
 {
-    char *path = (char *)pathv;
-    off_t sz = *(off_t *)szv;
-    int fd;
-    int witer;
-    off_t rpos, wpos;
-
-    say(1, (sizeof(off_t) == 8 ?
-            "disk_churn (%d): churning disk on %s (%ld bytes)\n" :
-            "disk_churn (%d): churning disk on %s (%d bytes)\n"),
-           getpid(), path, sz);
-    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
-        err("disk_churn (%d): Couldn't create %s: %s\n",
-                getpid(), path, strerror(errno));
-        exit(1);
-    }
-    if (0 && unlink(path) && errno != ENOENT) {
-        perror(path);
-        exit(1);
-    }
+    FILE *f;
+    char *line = NULL, source[64];
+    size_t cap = 0, alloc = 0;
+    int version, lineno = 1;
+    struct profile *p;
 
-    if (lseek(fd, sz - sizeof(fd), SEEK_SET) == (off_t)-1) {
-        perror("lseek");
-        exit(1);
+    if (strcmp(path, "-") == 0)
+        f = stdin;
+    else if ((f = fopen(path, "r")) == NULL) {
+        err("Couldn't open profile %s: %s\n", path, strerror(errno));
+        return NULL;
     }
-    if (write(fd, &fd, sizeof(fd)) == -1) {
-        perror("write");
+    if ((p = (struct profile *)calloc(1, sizeof(*p))) == NULL) {
+        perror("calloc");
         exit(1);
     }
-    
-    char *block = malloc(c_disk_churn_block_size);
-    if (block == NULL) {
-        perror("malloc");
-        _exit(1);
+    if (getline(&line, &cap, f) == -1 ||
+        sscanf(line, "lookbusy-profile %d interval=%d ncpus=%d source=%63s",
+               &version, &p->interval_ms, &p->ncpus, source) != 4) {
+        err("%s is not a lookbusy profile\n", path);
+        goto fail;
     }
+    if (version != PROFILE_VERSION || p->interval_ms <= 0 ||
+        p->ncpus <= 0 || p->ncpus > PROFILE_MAX_CPUS) {
+        err("%s: unsupported profile (version %d, interval %dms,"
+            " %d CPUs)\n", path, version, p->interval_ms, p->ncpus);
+        goto fail;
+    }
+    p->cgroup = strncmp(source, "cgroup:", 7) == 0;
 
-    witer = 0;
-    rpos = wpos = 0;
-    while (1) {
-        size_t p;
-        ssize_t r;
-
-        if (rpos >= sz) {
-            say(2, "disk_churn (%d) reader reached EOF at %ld\n",
-                   getpid(), (long)rpos);
-            rpos = 0;
-        }
-        if (wpos >= sz) {
-            say(2, "disk_churn (%d) writer reached EOF at %ld\n",
-                   getpid(), (long)wpos);
-            wpos = 0;
-            witer++;
-        }
-
-        for (p = 0; p < c_disk_churn_block_size; p++)
-            block[p] = (char)((witer | (int)p) & 0xff);
+    while (getline(&line, &cap, f) != -1) {
+        unsigned long long v[6];
+        char *s = line, *e;
+        int i;
 
-        if (lseek(fd, wpos, SEEK_SET) == (off_t)-1)  {
-            perror("lseek");
-            exit(1);
-        }
-        if (write(fd, block, c_disk_churn_block_size) == -1) {
-            perror("write");
-            exit(1);
+        lineno++;
+        if (*s == '#' || *s == '\n')
+            continue;
+        if (p->n == alloc) {
+            alloc = alloc ? alloc * 2 : 1024;
+            p->s = (struct profile_sample *)realloc(p->s,
+                                                    alloc * sizeof(*p->s));
+            p->cpu = (unsigned char *)realloc(p->cpu, alloc * p->ncpus);
+            if (p->s == NULL || p->cpu == NULL) {
+                perror("realloc");
+                exit(1);
+            }
         }
-        wpos += c_disk_churn_step_size * 2;
-
-        if (lseek(fd, rpos, SEEK_SET) == (off_t)-1)  {
-            perror("lseek");
-            exit(1);
+        for (i = 0; i < 6; i++) {
+            v[i] = strtoull(s, &e, 10);
+            if (e == s)
+                break;
+            s = e;
         }
-        r = read(fd, block, c_disk_churn_block_size);
-        if (r == -1) {
-            err("disk_churn (%d): error reading from %s at %ld: %s\n",
-                    getpid(), path, (long)rpos, strerror(errno));
-            exit(1);
+        for (; i >= 6 && i < 6 + p->ncpus; i++) {
+            unsigned long long u = strtoull(s, &e, 10);
+            if (e == s)
+                break;
+            p->cpu[p->n * p->ncpus + i - 6] = u > 100 ? 100 : (unsigned char)u;
+            s = e;
         }
-        if (r == 0) {
-            say(1, "disk_churn (%d): reader reached EOF early (at %ld)\n",
-                   getpid(), (long)rpos);
-            rpos = 0;
+        if (i != 6 + p->ncpus) {
+            err("%s:%d: expected %d fields\n", path, lineno, 6 + p->ncpus);
+            goto fail;
         }
-        rpos += c_disk_churn_step_size;
-        usleep(c_disk_churn_sleep * 1000);
+        /* v[0], the timestamp, is informational; samples are taken to be
+         * evenly spaced */
+        p->s[p->n].mem_kb = v[1];
+        p->s[p->n].rd_iops = v[2];
+        p->s[p->n].wr_iops = v[3];
+        p->s[p->n].rd_kbps = v[4];
+        p->s[p->n].wr_kbps = v[5];
+        p->n++;
     }
-    _exit(0);
+    if (p->n == 0) {
+        err("%s: profile has no samples\n", path);
+        goto fail;
+    }
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return p;
+
+fail:
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    free(p->s);
+    free(p->cpu);
+    free(p);
+    return NULL;
 }
 
+/* What `lookbusy record` keeps between samples */
+struct record_state {
+    const char *cgroup;         /* directory, or NULL for the whole host */
+    int ncpus;
+    uint64_t *busy, *total;     /* per CPU, jiffies */
+    uint64_t cg_usage;          /* cgroup CPU time, usec */
+    uint64_t rd_ios, wr_ios, rd_bytes, wr_bytes;
+    uint64_t time;
+};
 
-static pid_t fork_and_call(char *desc, spinner_fn fn, long long arg1, long long arg2, long long arg3, void *argP, void *argP2)
+static int record_read_file_u64(const char *dir, const char *name,
+                                const char *key, uint64_t *v)
 {
-    pid_t p = fork();
-    if (p == -1) {
-        perror("fork");
-        return 0;
-    }
-    else if (p == 0) {
-        if (cpu_pids != NULL) {
-            free(cpu_pids);
-            cpu_pids = NULL;
-        }
-        if (disk_pids != NULL) {
-            free(disk_pids);
-            disk_pids = NULL;
+    char path[512], s[256];
+    unsigned long long u;
+    size_t klen = key ? strlen(key) : 0;
+    FILE *f;
+    int found = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    while (!found && fgets(s, sizeof(s), f) != NULL) {
+        if (key == NULL) {
+            found = sscanf(s, "%llu", &u) == 1;
+        } else if (strncmp(s, key, klen) == 0 && s[klen] == ' ') {
+            found = sscanf(s + klen, "%llu", &u) == 1;
         }
-        mem_pid = 0;
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
-        signal(SIGCHLD, SIG_DFL);
-        (*fn)(arg1, arg2, arg3, argP, argP2);
-        exit(0);
-    } else {
-        say(1, "lookbusy (%d): %s started, PID %d\n", getpid(), desc, p);
-        return p;
     }
+    fclose(f);
+    if (found)
+        *v = u;
+    return found ? 0 : -1;
 }
 
-static pid_t *start_cpu_spinners(int *ncpus, int util_l, int util_h)
+/* cumulative per-CPU busy/total jiffies, in /proc/stat order */
+static int record_read_cpus(struct record_state *st, uint64_t *busy,
+                            uint64_t *total)
 {
-    pid_t *pids;
-    if (*ncpus <= 0)
-        *ncpus = get_cpu_count();
-    if ((pids = (pid_t *)malloc(sizeof(*pids) * *ncpus)) == NULL) {
-        perror("malloc");
-        return NULL;
-    }
-    int i;
-    say(1, "cpu_spin (%d): starting %d spinner(s) for %d%%-%d%% usage\n",
-           getpid(), *ncpus, util_l, util_h);
-    for (i = 0; i < *ncpus; i++) {
-        pids[i] = fork_and_call("CPU spinner", cpu_spin, *ncpus, util_l, util_h, NULL, NULL);
+    FILE *f;
+    char s[256];
+    int n = 0, cpu;
+
+    if ((f = fopen("/proc/stat", "r")) == NULL)
+        return -1;
+    while (fgets(s, sizeof(s), f) != NULL && n < st->ncpus) {
+        if (parse_cpu_stat_line(s, &cpu, &busy[n], &total[n]))
+            n++;
     }
-    return pids;
+    fclose(f);
+    return n;
 }
 
-static pid_t *start_disk_stirrer(off_t util, char **paths, size_t paths_n)
+/* cumulative completed I/Os and bytes, over the host's physical disks or
+ * the cgroup's io.stat */
+static void record_read_io(struct record_state *st, uint64_t *rios,
+                           uint64_t *wios, uint64_t *rbytes, uint64_t *wbytes)
 {
-    size_t i;
-    pid_t *p = malloc(sizeof(*p) * paths_n);
-
-    for (i = 0; i < paths_n; i++) {
-        struct stat st;
-        if (stat(paths[i], &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                if (access(paths[i], W_OK) != 0) {
-                    err("disk path %s is not writable\n", paths[i]);
-                    shutdown();
-                }
-                char *tmpl = (char *)malloc(strlen(paths[i]) + 32);
-                if (tmpl == NULL) {
-                    perror("malloc");
-                    shutdown();
-                }
-                snprintf(tmpl, strlen(paths[i]) + 31, "%s/lb.%d.XXXXXX",
-                         paths[i], getpid());
-                int fd = mkstemp(tmpl);
-                if (fd == -1) {
-                    perror("mkstemp");
-                    free(tmpl);
-                    shutdown();
-                }
+    char s[512], path[512];
+    FILE *f;
 
-                free(paths[i]);
-                paths[i] = tmpl;
+    *rios = *wios = *rbytes = *wbytes = 0;
+    if (st->cgroup != NULL) {
+        snprintf(path, sizeof(path), "%s/io.stat", st->cgroup);
+        if ((f = fopen(path, "r")) == NULL)
+            return;
+        while (fgets(s, sizeof(s), f) != NULL) {
+            char *tok;
+            unsigned long long v;
+            for (tok = strtok(s, " \n"); tok; tok = strtok(NULL, " \n")) {
+                if (sscanf(tok, "rbytes=%llu", &v) == 1) *rbytes += v;
+                else if (sscanf(tok, "wbytes=%llu", &v) == 1) *wbytes += v;
+                else if (sscanf(tok, "rios=%llu", &v) == 1) *rios += v;
+                else if (sscanf(tok, "wios=%llu", &v) == 1) *wios += v;
             }
         }
+        fclose(f);
+        return;
+    }
 
-        char *desc = (char *)malloc(32 + strlen(paths[i]));
-        if (desc == NULL) {
-            perror("malloc");
-            shutdown();
-        }
-        snprintf(desc, 31 + strlen(paths[i]), "disk churn: %s", paths[i]); 
-        p[i] = fork_and_call(desc, disk_churn, 0, 0, 0, paths[i], &util);
+    if ((f = fopen("/proc/diskstats", "r")) == NULL)
+        return;
+    while (fgets(s, sizeof(s), f) != NULL) {
+        unsigned maj, min;
+        char name[64];
+        unsigned long long rd, rdm, rsec, rt, wr, wrm, wsec;
+        struct stat sb;
+
+        if (sscanf(s, "%u %u %63s %llu %llu %llu %llu %llu %llu %llu",
+                   &maj, &min, name, &rd, &rdm, &rsec, &rt, &wr, &wrm,
+                   &wsec) != 10)
+            continue;
+        /* whole physical devices only: partitions, device-mapper and md
+         * would count the same I/O twice, and loop/ram devices aren't
+         * disks */
+        snprintf(path, sizeof(path), "/sys/block/%s/device", name);
+        if (stat(path, &sb) != 0)
+            continue;
+        *rios += rd;
+        *wios += wr;
+        *rbytes += rsec * 512;
+        *wbytes += wsec * 512;
     }
-    return p;
+    fclose(f);
 }
 
-static pid_t start_mem_whisker(size_t sz)
+static int record_open(struct record_state *st, const char *cgroup)
 {
-    return fork_and_call("mem stirrer", mem_stir, sz, 0, 0, NULL, NULL);
+    static char dir[512];
+    uint64_t v;
+
+    memset(st, 0, sizeof(*st));
+    if (cgroup != NULL) {
+        if (cgroup[0] == '/' && strncmp(cgroup, "/sys/fs/cgroup", 14) == 0)
+            snprintf(dir, sizeof(dir), "%s", cgroup);
+        else
+            snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s",
+                     cgroup + (cgroup[0] == '/'));
+        if (record_read_file_u64(dir, "memory.current", NULL, &v) == -1 ||
+            record_read_file_u64(dir, "cpu.stat", "usage_usec", &v) == -1) {
+            err("%s is not a cgroup v2 directory with the cpu and memory"
+                " controllers\n", dir);
+            return -1;
+        }
+        st->cgroup = dir;
+    }
+    st->ncpus = PROFILE_MAX_CPUS;
+    st->busy = (uint64_t *)calloc(PROFILE_MAX_CPUS, sizeof(uint64_t));
+    st->total = (uint64_t *)calloc(PROFILE_MAX_CPUS, sizeof(uint64_t));
+    if (st->busy == NULL || st->total == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    if ((st->ncpus = record_read_cpus(st, st->busy, st->total)) <= 0) {
+        err("Couldn't read per-CPU times from /proc/stat\n");
+        return -1;
+    }
+    if (st->cgroup != NULL)
+        record_read_file_u64(st->cgroup, "cpu.stat", "usage_usec",
+                             &st->cg_usage);
+    record_read_io(st, &st->rd_ios, &st->wr_ios, &st->rd_bytes,
+                   &st->wr_bytes);
+    st->time = mono_nsec();
+    return 0;
+}
+
+/* take one sample, as the usage since the last one */
+static void record_sample(struct record_state *st, struct profile_sample *ps,
+                          unsigned char *cpu)
+{
+    uint64_t busy[PROFILE_MAX_CPUS], total[PROFILE_MAX_CPUS];
+    uint64_t rios, wios, rbytes, wbytes, now = mono_nsec();
+    double secs = (now - st->time) / 1e9;
+    int i, n;
+
+    n = record_read_cpus(st, busy, total);
+    if (st->cgroup != NULL) {
+        uint64_t usage = st->cg_usage, mem = 0;
+        double pct;
+
+        /* cgroups account CPU time as a whole; spread it evenly */
+        record_read_file_u64(st->cgroup, "cpu.stat", "usage_usec", &usage);
+        pct = secs > 0 ? (usage - st->cg_usage) / 1e4 / secs / st->ncpus : 0;
+        for (i = 0; i < st->ncpus; i++)
+            cpu[i] = pct > 100 ? 100 : (unsigned char)(pct + .5);
+        st->cg_usage = usage;
+        record_read_file_u64(st->cgroup, "memory.current", NULL, &mem);
+        ps->mem_kb = mem / 1024;
+    } else {
+        for (i = 0; i < st->ncpus; i++) {
+            uint64_t db = 0, dt = 0;
+            if (i < n && total[i] > st->total[i]) {
+                db = busy[i] - st->busy[i];
+                dt = total[i] - st->total[i];
+            }
+            cpu[i] = dt ? (unsigned char)((100 * db + dt / 2) / dt) : 0;
+            if (cpu[i] > 100)
+                cpu[i] = 100;
+        }
+        ps->mem_kb = host_mem_used_kb(NULL);
+    }
+    if (n == st->ncpus) {
+        memcpy(st->busy, busy, n * sizeof(*busy));
+        memcpy(st->total, total, n * sizeof(*total));
+    }
+
+    record_read_io(st, &rios, &wios, &rbytes, &wbytes);
+    if (secs > 0) {
+        ps->rd_iops = (uint64_t)((rios - st->rd_ios) / secs + .5);
+        ps->wr_iops = (uint64_t)((wios - st->wr_ios) / secs + .5);
+        ps->rd_kbps = (uint64_t)((rbytes - st->rd_bytes) / 1024. / secs + .5);
+        ps->wr_kbps = (uint64_t)((wbytes - st->wr_bytes) / 1024. / secs + .5);
+    }
+    st->rd_ios = rios;
+    st->wr_ios = wios;
+    st->rd_bytes = rbytes;
+    st->wr_bytes = wbytes;
+    st->time = now;
+}
+
+static void record_usage()
+{
+    printf("usage: lookbusy record [ options ] [ FILE ]\n"
+"Samples this host's (or a cgroup's) CPU, memory and disk usage into FILE\n"
+"(default standard output), for later use with --replay.\n"
+"  -i, --interval=MSEC  Sampling interval, in msec (default 1000)\n"
+"  -t, --duration=TIME  Stop after this long, in seconds (append 'm', 'h',\n"
+"                         'd' for other units; default: until interrupted)\n"
+"  -g, --cgroup=PATH    Record a cgroup (v2) instead of the whole host\n"
+"  -q, --quiet          Be quiet, produce output on errors only\n"
+"  -v, --verbose        Verbose output (may be repeated)\n");
+    exit(0);
+}
+
+static int record_main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        { "help", 0, NULL, 'h' },
+        { "verbose", 0, NULL, 'v' },
+        { "quiet", 0, NULL, 'q' },
+        { "interval", 1, NULL, 'i' },
+        { "duration", 1, NULL, 't' },
+        { "cgroup", 1, NULL, 'g' },
+        { 0, 0, 0, 0 }
+    };
+    struct record_state st;
+    struct profile_sample ps;
+    unsigned char *cpu;
+    const char *path = "-", *cgroup = NULL;
+    int interval = 1000, duration = 0, c, i;
+    uint64_t start, next, t;
+    FILE *out = stdout;
+
+    while ((c = getopt_long(argc, argv, "i:t:g:qvh", long_options,
+                            NULL)) != -1) {
+        switch (c) {
+            default:
+            case 'h': record_usage(); break;
+            case 'i':
+                if ((interval = atoi(optarg)) <= 0) {
+                    err("Sampling interval must be a positive number of"
+                        " milliseconds\n");
+                    return 1;
+                }
+                break;
+            case 't':
+                if (parse_timespan(optarg, &duration) < 0) {
+                    err("Couldn't parse duration '%s'; format is"
+                        " INTEGER[SUFFIX], where SUFFIX\n"
+                        "is one of 's' (seconds), 'm' (minutes), 'h' (hours)"
+                        ", or 'd' (days); e.g. \"2h\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g':
+                cgroup = optarg;
+                break;
+            case 'q':
+                verbosity = 0;
+                break;
+            case 'v':
+                verbosity++;
+                break;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind++];
+    if (optind < argc)
+        record_usage();
+
+    if (record_open(&st, cgroup) < 0)
+        return 1;
+    if (strcmp(path, "-") != 0 && (out = fopen(path, "w")) == NULL) {
+        err("Couldn't create %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (out == stdout)
+        verbosity = 0; /* keep the profile clean */
+    if ((cpu = (unsigned char *)malloc(st.ncpus)) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    fprintf(out, "lookbusy-profile %d interval=%d ncpus=%d source=%s%s\n",
+            PROFILE_VERSION, interval, st.ncpus, cgroup ? "cgroup:" : "host",
+            cgroup ? st.cgroup : "");
+    fprintf(out, "# t_ms mem_kb rd_iops wr_iops rd_kbps wr_kbps");
+    for (i = 0; i < st.ncpus; i++)
+        fprintf(out, " cpu%d", i);
+    fprintf(out, "\n");
+    say(1, "record (%d): sampling %s, %d CPUs, every %dms into %s\n",
+           getpid(), cgroup ? st.cgroup : "host", st.ncpus, interval, path);
+
+    start = next = st.time;
+    while (1) {
+        next += (uint64_t)interval * 1000000;
+        sleep_until_nsec(next);
+        record_sample(&st, &ps, cpu);
+        t = (st.time - start) / 1000000 - interval;
+        fprintf(out, "%"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64
+                " %"PRIu64, t, ps.mem_kb, ps.rd_iops, ps.wr_iops,
+                ps.rd_kbps, ps.wr_kbps);
+        for (i = 0; i < st.ncpus; i++)
+            fprintf(out, " %d", cpu[i]);
+        fprintf(out, "\n");
+        if (fflush(out) == EOF || ferror(out)) {
+            err("Error writing %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        if (duration > 0 &&
+            st.time - start >= (uint64_t)duration * 1000000000)
+            break;
+    }
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
+
+
+/* A ping-pong pair: two processes handing a token back and forth, each
+ * handoff being one wakeup and (unless both ends share a CPU and the waker
+ * keeps running) one context switch.
+ */
+struct sched_shared {
+    uint32_t futex[2]; /* per direction */
+    pid_t pid[2];      /* per side, once it's running */
+};
+
+struct sched_pair {
+    int fd[2][2];      /* per direction: pipe ends, or eventfd in [0] */
+    struct sched_shared *shared; /* mapped shared by the two sides */
+    int cpu[2];        /* per side; -1 if unpinned */
+};
+
+/* An eventfd or futex wait doesn't notice the partner dying, so it gives
+ * up this often to check. */
+#define SCHED_PARTNER_CHECK 1000 /* msec */
+
+/* whether the side posting in direction dir is still running (or has yet
+ * to start) */
+static int sched_partner_alive(struct sched_pair *pair, int dir)
+{
+    static int pidfd = -1;
+    pid_t pid = __atomic_load_n(&pair->shared->pid[dir], __ATOMIC_ACQUIRE);
+
+    if (pid == 0)
+        return 1;
+#ifdef SYS_pidfd_open
+    /* unlike kill(), sees the partner go even before it's reaped */
+    if (pidfd == -1)
+        pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd != -1) {
+        struct pollfd pfd = { pidfd, POLLIN, 0 };
+        return poll(&pfd, 1, 0) == 0;
+    }
+#endif
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static void sched_post(struct sched_pair *pair, int dir)
+{
+    uint64_t one = 1;
+    ssize_t r = 1;
+
+    switch (c_sched_method) {
+        case SCHED_METHOD_PIPE:
+            r = write(pair->fd[dir][1], &one, 1);
+            break;
+        case SCHED_METHOD_EVENTFD:
+            r = write(pair->fd[dir][0], &one, sizeof(one));
+            break;
+        case SCHED_METHOD_FUTEX:
+#ifdef HAVE_LINUX_FUTEX_H
+            __atomic_store_n(&pair->shared->futex[dir], 1, __ATOMIC_RELEASE);
+            syscall(SYS_futex, &pair->shared->futex[dir], FUTEX_WAKE, 1,
+                    NULL, NULL, 0);
+#endif
+            break;
+    }
+    if (r <= 0) {
+        err("sched_pingpong (%d): post failed: %s\n", getpid(),
+            r == 0 ? "partner went away" : strerror(errno));
+        _exit(1);
+    }
+}
+
+static void sched_wait(struct sched_pair *pair, int dir)
+{
+    uint64_t buf;
+    ssize_t r = 1;
+
+    switch (c_sched_method) {
+        case SCHED_METHOD_PIPE:
+            while ((r = read(pair->fd[dir][0], &buf, 1)) == -1 && errno == EINTR)
+                ;
+            break;
+        case SCHED_METHOD_EVENTFD: {
+            struct pollfd pfd = { pair->fd[dir][0], POLLIN, 0 };
+            int n;
+            while ((n = poll(&pfd, 1, SCHED_PARTNER_CHECK)) != 1) {
+                if (n == -1 && errno != EINTR) {
+                    r = -1;
+                    break;
+                }
+                if (n == 0 && !sched_partner_alive(pair, dir)) {
+                    r = 0;
+                    break;
+                }
+            }
+            if (n == 1)
+                while ((r = read(pair->fd[dir][0], &buf, sizeof(buf))) == -1 &&
+                       errno == EINTR)
+                    ;
+            break;
+        }
+        case SCHED_METHOD_FUTEX:
+#ifdef HAVE_LINUX_FUTEX_H
+            while (__atomic_exchange_n(&pair->shared->futex[dir], 0,
+                                       __ATOMIC_ACQUIRE) == 0) {
+                struct timespec ts = { SCHED_PARTNER_CHECK / 1000,
+                                       SCHED_PARTNER_CHECK % 1000 * 1000000 };
+                if (syscall(SYS_futex, &pair->shared->futex[dir], FUTEX_WAIT,
+                            0, &ts, NULL, 0) == -1 && errno == ETIMEDOUT &&
+                    !sched_partner_alive(pair, dir)) {
+                    r = 0;
+                    break;
+                }
+            }
+#endif
+            break;
+    }
+    if (r <= 0) {
+        err("sched_pingpong (%d): wait failed: %s\n", getpid(),
+            r == 0 ? "partner went away" : strerror(errno));
+        _exit(1);
+    }
+}
+
+static void sched_pingpong(long long side, long long index, long long npairs, void *pairp, void *dummy)
+{
+    struct sched_pair *pair = (struct sched_pair *)pairp;
+    /* each round trip is two handoffs */
+    const uint64_t interval = c_sched_rate > 0 ?
+        (uint64_t)(2e9 * npairs / c_sched_rate) : 0;
+    uint64_t next, now, t0, last_report;
+    uint64_t trips = 0, rtt_sum = 0, rtt_max = 0;
+    struct rusage ru, last_ru;
+
+    /* keep only our own ends of the pipes, so that reads see the partner
+     * exit and writes fail rather than fill up */
+    if (c_sched_method == SCHED_METHOD_PIPE) {
+        signal(SIGPIPE, SIG_IGN);
+        close(pair->fd[side][0]);
+        close(pair->fd[!side][1]);
+    }
+    __atomic_store_n(&pair->shared->pid[side], getpid(), __ATOMIC_RELEASE);
+    if (pair->cpu[side] >= 0)
+        cpu_pin("sched_pingpong", pair->cpu[side]);
+    say(2, "sched_pingpong (%d): pair %lld %s via %s\n", getpid(), index,
+           side ? "responding" : "initiating",
+           sched_method_names[c_sched_method]);
+
+    if (side == 1) {
+        while (1) {
+            sched_wait(pair, 0);
+            sched_post(pair, 1);
+            perf_sample();
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &last_ru);
+    next = last_report = mono_nsec();
+    while (1) {
+        if (interval) {
+            now = mono_nsec();
+            if (now < next)
+                sleep_until_nsec(next);
+            else if (now - next > 1000000000)
+                next = now; /* too far behind; don't catch up in a burst */
+            next += interval;
+        }
+        t0 = mono_nsec();
+        sched_post(pair, 0);
+        sched_wait(pair, 1);
+        now = mono_nsec();
+        trips++;
+        rtt_sum += now - t0;
+        if (now - t0 > rtt_max)
+            rtt_max = now - t0;
+
+        if (c_stats_interval > 0 &&
+            now - last_report >= (uint64_t)c_stats_interval * 1000000000) {
+            double secs = (now - last_report) / 1e9;
+            char target[32] = "unpaced";
+
+            if (c_sched_rate > 0)
+                snprintf(target, sizeof(target), "target %.0f",
+                         (double)c_sched_rate / npairs);
+            getrusage(RUSAGE_SELF, &ru);
+            say(1, "sched_pingpong (%d): pair %lld: %.0f handoffs/sec"
+                   " (%s); round trip avg %.1f usec, max %.1f usec;"
+                   " %.0f voluntary, %.0f involuntary switches/sec\n",
+                   getpid(), index, trips * 2 / secs, target,
+                   rtt_sum / 1e3 / trips, rtt_max / 1e3,
+                   (ru.ru_nvcsw - last_ru.ru_nvcsw) / secs,
+                   (ru.ru_nivcsw - last_ru.ru_nivcsw) / secs);
+            last_ru = ru;
+            last_report = now;
+            trips = rtt_sum = rtt_max = 0;
+        }
+        perf_sample();
+    }
+    _exit(1);
+}
+
+/* State shared by all contention workers.  Each contended object sits on
+ * its own cache line; the false-sharing slots deliberately share one.
+ */
+struct contend_shared {
+    uint64_t counter __attribute__((aligned(CACHE_LINE)));
+    pthread_mutex_t mutex __attribute__((aligned(CACHE_LINE)));
+    pthread_rwlock_t rwlock __attribute__((aligned(CACHE_LINE)));
+    uint64_t protected_value __attribute__((aligned(CACHE_LINE)));
+    uint64_t *slots;    /* a word per worker, as many to a line as fit;
+                         * mapped after the stats */
+    struct {
+        uint64_t ops __attribute__((aligned(CACHE_LINE)));
+    } stats[];    /* per worker, for the aggregate report */
+};
+
+/* the same objects again, but private to one worker */
+struct contend_private {
+    uint64_t counter;
+    pthread_mutex_t mutex;
+    pthread_rwlock_t rwlock;
+    uint64_t protected_value;
+    uint64_t slot;
+};
+
+static void contend_op(struct contend_shared *sh, struct contend_private *pv,
+                       uint64_t i, int index, int shared)
+{
+    switch (c_contend_op) {
+        case CONTEND_ATOMIC:
+            __atomic_fetch_add(shared ? &sh->counter : &pv->counter, 1,
+                               __ATOMIC_SEQ_CST);
+            break;
+        case CONTEND_MUTEX: {
+            pthread_mutex_t *m = shared ? &sh->mutex : &pv->mutex;
+            /* a contender killed holding it leaves only the counter, which
+             * doesn't need to be exact */
+            if (pthread_mutex_lock(m) == EOWNERDEAD)
+                pthread_mutex_consistent(m);
+            (*(volatile uint64_t *)(shared ? &sh->protected_value :
+                                    &pv->protected_value))++;
+            pthread_mutex_unlock(m);
+            break;
+        }
+        case CONTEND_RWLOCK: {
+            /* mostly readers, as rwlocks usually are */
+            pthread_rwlock_t *l = shared ? &sh->rwlock : &pv->rwlock;
+            volatile uint64_t *v = shared ? &sh->protected_value :
+                                            &pv->protected_value;
+            if (i % 10 == 0) {
+                pthread_rwlock_wrlock(l);
+                (*v)++;
+            } else {
+                pthread_rwlock_rdlock(l);
+                (void)*v;
+            }
+            pthread_rwlock_unlock(l);
+            break;
+        }
+        case CONTEND_FALSESHARE:
+            /* no two workers touch the same word, only the same line */
+            (*(volatile uint64_t *)(shared ? &sh->slots[index] :
+                                             &pv->slot))++;
+            break;
+    }
+}
+
+static void contend(long long index, long long nworkers, long long cpu, void *shp, void *dummy)
+{
+    struct contend_shared *sh = (struct contend_shared *)shp;
+    struct contend_private pv;
+    const uint64_t batch = 1024;
+    uint64_t i = 0, ops = 0, ns = 0, worst = 0;
+    uint64_t last_report, last_total = 0;
+
+    if (cpu >= 0)
+        cpu_pin("contend", cpu);
+    memset(&pv, 0, sizeof(pv));
+    pthread_mutex_init(&pv.mutex, NULL);
+    pthread_rwlock_init(&pv.rwlock, NULL);
+
+    say(2, "contend (%d): worker %lld hammering %s, %d%% shared\n",
+           getpid(), index, contend_op_names[c_contend_op], c_contend_ratio);
+    if (index == 0) {
+        int w;
+        for (w = 0; w < nworkers; w++)
+            last_total += __atomic_load_n(&sh->stats[w].ops,
+                                          __ATOMIC_RELAXED);
+    }
+    last_report = mono_nsec();
+    while (1) {
+        uint64_t t0, t1, end = i + batch;
+
+        /* time whole batches, so that clock reads don't dominate; sample
+         * one operation per batch on its own to catch the outliers */
+        t0 = mono_nsec();
+        contend_op(sh, &pv, i, index, (int)(i % 100) < c_contend_ratio);
+        t1 = mono_nsec();
+        if (t1 - t0 > worst)
+            worst = t1 - t0;
+        for (i++; i < end; i++)
+            contend_op(sh, &pv, i, index, (int)(i % 100) < c_contend_ratio);
+        ops += batch;
+        ns += mono_nsec() - t0;
+        /* added to, not stored, so that a restarted worker's count
+         * carries on from its predecessor's */
+        __atomic_fetch_add(&sh->stats[index].ops, batch, __ATOMIC_RELAXED);
+
+        if (c_stats_interval > 0 &&
+            t1 - last_report >= (uint64_t)c_stats_interval * 1000000000) {
+            double secs = (t1 - last_report) / 1e9;
+
+            say(1, "contend (%d): worker %lld: %.0f ops/sec, %.1f ns/op avg,"
+                   " %"PRIu64" ns worst sampled\n", getpid(), index,
+                   ops / secs, (double)ns / ops, worst);
+            if (index == 0) {
+                uint64_t total = 0;
+                int w;
+                for (w = 0; w < nworkers; w++)
+                    total += __atomic_load_n(&sh->stats[w].ops,
+                                             __ATOMIC_RELAXED);
+                say(1, "contend (%d): all %lld workers: %.0f ops/sec on %s\n",
+                       getpid(), nworkers, (total - last_total) / secs,
+                       contend_op_names[c_contend_op]);
+                last_total = total;
+            }
+            ops = ns = worst = 0;
+            last_report = t1;
+        }
+        perf_sample();
+    }
+    _exit(1);
+}
+
+/* Log-linear latency histogram, in nanoseconds: exact below 16ns, then 16
+ * buckets per power of two (within about 6%), up to the full 64-bit range.
+ */
+#define HIST_SUB 16
+#define HIST_BUCKETS (HIST_SUB + 60 * HIST_SUB)
+
+struct latency_hist {
+    uint64_t count[HIST_BUCKETS];
+};
+
+static int hist_bucket(uint64_t v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+        return (int)v;
+    e = 63 - __builtin_clzll(v);
+    return HIST_SUB + (e - 4) * HIST_SUB + (int)((v >> (e - 4)) - HIST_SUB);
+}
+
+/* the upper bound of a bucket */
+static uint64_t hist_value(int b)
+{
+    int e;
+
+    if (b < HIST_SUB)
+        return b;
+    e = (b - HIST_SUB) / HIST_SUB + 4;
+    return ((uint64_t)(HIST_SUB + (b - HIST_SUB) % HIST_SUB + 1) << (e - 4)) - 1;
+}
+
+/* the value below which fraction q of the n samples in h fall */
+static uint64_t hist_quantile(const struct latency_hist *h, uint64_t n,
+                              double q)
+{
+    uint64_t rank = (uint64_t)ceil(q * n), seen = 0;
+    int b;
+
+    if (n == 0)
+        return 0;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen >= rank && seen > 0)
+            return hist_value(b);
+    }
+    return hist_value(HIST_BUCKETS - 1);
+}
+
+/* Open-loop request load: a dispatcher enqueues requests at random arrival
+ * times regardless of how quickly they're being served, and a pool of
+ * workers serves them in order.  Each request carries its scheduled
+ * arrival time, so that time spent waiting -- for a worker, or for the
+ * dispatcher itself to fall behind -- counts as queueing.
+ */
+#define REQ_QUEUE_LEN 65536
+#define REQ_BURST_MEAN 100000000ULL /* nsec; mean length of a burst */
+
+enum req_latency {
+    REQ_QUEUE = 0,
+    REQ_SERVICE,
+    REQ_TOTAL,
+    REQ_NLATENCIES
+};
+static const char *req_latency_names[] = { "queue", "service", "total" };
+
+struct req {
+    uint64_t arrival;           /* scheduled, mono_nsec() */
+    uint64_t cpu_iters;         /* sampled by the dispatcher */
+};
+
+struct req_shared {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    uint64_t head, tail;        /* enqueued, dequeued so far */
+    uint64_t offered, dropped;
+    int disk_fd;
+    size_t disk_size;
+    struct req queue[REQ_QUEUE_LEN];
+    struct req_stats {
+        uint64_t done __attribute__((aligned(CACHE_LINE)));
+        uint64_t busy_ns;
+        struct latency_hist hist[REQ_NLATENCIES];
+    } stats[];                  /* per worker */
+};
+
+static void req_lock(struct req_shared *sh)
+{
+    /* a worker killed holding the lock leaves the queue consistent: only
+     * the head and tail move, each in a single store */
+    if (pthread_mutex_lock(&sh->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&sh->lock);
+}
+
+static void req_serve(long long index, long long nworkers, long long dummy, void *shp, void *dummyp)
+{
+    struct req_shared *sh = (struct req_shared *)shp;
+    struct req_stats *st = &sh->stats[index];
+    const size_t line = CACHE_LINE;
+    size_t pool = c_req_mem * 16, touches = c_req_mem / line;
+    char *mem = NULL, *disk_buf = NULL;
+    uint64_t rng = rng_seed();
+
+    if (touches > 0) {
+        if (pool < 1024 * 1024)
+            pool = 1024 * 1024;
+        if ((mem = (char *)malloc(pool)) == NULL) {
+            perror("malloc");
+            _exit(1);
+        }
+        memset(mem, 1, pool);
+    }
+    if (c_req_disk > 0 && (disk_buf = (char *)malloc(c_req_disk)) == NULL) {
+        perror("malloc");
+        _exit(1);
+    }
+    say(2, "req_serve (%d): worker %lld ready\n", getpid(), index);
+
+    while (1) {
+        struct req r;
+        uint64_t start, end;
+        size_t i;
+
+        req_lock(sh);
+        while (sh->head == sh->tail) {
+            if (pthread_cond_wait(&sh->nonempty, &sh->lock) == EOWNERDEAD)
+                pthread_mutex_consistent(&sh->lock);
+        }
+        r = sh->queue[sh->tail % REQ_QUEUE_LEN];
+        sh->tail++;
+        pthread_mutex_unlock(&sh->lock);
+
+        start = mono_nsec();
+        if (r.cpu_iters > 0)
+            cpu_kernels[c_cpu_kernel].fn(r.cpu_iters);
+        /* random cache lines across a pool well beyond the request's own
+         * footprint, as a service's working set would be */
+        for (i = 0; i < touches; i++)
+            mem[(rng_next(&rng) % (pool / line)) * line]++;
+        if (disk_buf != NULL) {
+            off_t off = (off_t)(rng_next(&rng) %
+                                (sh->disk_size / c_req_disk)) * c_req_disk;
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(sh->disk_fd, off, c_req_disk, POSIX_FADV_DONTNEED);
+#endif
+            if (pread(sh->disk_fd, disk_buf, c_req_disk, off) == -1) {
+                err("req_serve (%d): read error: %s\n", getpid(),
+                    strerror(errno));
+                _exit(1);
+            }
+        }
+        end = mono_nsec();
+
+        st->hist[REQ_QUEUE].count[hist_bucket(start > r.arrival ?
+                                              start - r.arrival : 0)]++;
+        st->hist[REQ_SERVICE].count[hist_bucket(end - start)]++;
+        st->hist[REQ_TOTAL].count[hist_bucket(end > r.arrival ?
+                                              end - r.arrival : 0)]++;
+        st->busy_ns += end - start;
+        __atomic_store_n(&st->done, st->done + 1, __ATOMIC_RELEASE);
+        perf_sample();
+    }
+    _exit(1);
+}
+
+/* mean requests/sec in and out of a burst, keeping the overall mean at
+ * c_req_rate: bursts run at c_req_burst times the rate and carry half of
+ * all requests */
+static void req_burst_rates(double *on, double *off, double *on_fraction)
+{
+    *on_fraction = 1. / (2 * c_req_burst);
+    *on = c_req_rate * c_req_burst;
+    *off = c_req_rate * .5 / (1 - *on_fraction);
+}
+
+static uint64_t req_sample_iters(uint64_t *rng)
+{
+    if (c_req_cpu <= 0)
+        return 0;
+    return (uint64_t)(rng_sample(rng, c_req_cpu_dist, c_req_cpu) *
+                      cpu_spin_rate / 1e6);
+}
+
+static void req_report(struct req_shared *sh, int nworkers,
+                       struct latency_hist *prev, uint64_t *prev_done,
+                       uint64_t *prev_busy, uint64_t *prev_offered,
+                       uint64_t *prev_dropped, double secs)
+{
+    struct latency_hist cur[REQ_NLATENCIES];
+    uint64_t done = 0, busy = 0, n, maxv;
+    int w, l, b;
+    char buf[512];
+    size_t len = 0;
+
+    memset(cur, 0, sizeof(cur));
+    for (w = 0; w < nworkers; w++) {
+        done += __atomic_load_n(&sh->stats[w].done, __ATOMIC_ACQUIRE);
+        busy += sh->stats[w].busy_ns;
+        for (l = 0; l < REQ_NLATENCIES; l++)
+            for (b = 0; b < HIST_BUCKETS; b++)
+                cur[l].count[b] += sh->stats[w].hist[l].count[b];
+    }
+    n = done - *prev_done;
+    for (l = 0; l < REQ_NLATENCIES; l++) {
+        struct latency_hist d;
+        maxv = 0;
+        for (b = 0; b < HIST_BUCKETS; b++) {
+            d.count[b] = cur[l].count[b] - prev[l].count[b];
+            if (d.count[b])
+                maxv = hist_value(b);
+        }
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "%s%s p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f"
+                        " max %.0f", l ? "; " : "", req_latency_names[l],
+                        hist_quantile(&d, n, .5) / 1e3,
+                        hist_quantile(&d, n, .9) / 1e3,
+                        hist_quantile(&d, n, .99) / 1e3,
+                        hist_quantile(&d, n, .999) / 1e3, maxv / 1e3);
+        prev[l] = cur[l];
+    }
+    say(1, "requests (%d): %.0f/sec offered, %.0f/sec served, %.0f dropped,"
+           " %.0f%% busy; latency in usec: %s\n", getpid(),
+           (sh->offered - *prev_offered) / secs, n / secs,
+           (double)(sh->dropped - *prev_dropped),
+           100. * (busy - *prev_busy) / 1e9 / secs / nworkers, buf);
+    *prev_done = done;
+    *prev_busy = busy;
+    *prev_offered = sh->offered;
+    *prev_dropped = sh->dropped;
+}
+
+static void req_dispatch(long long nworkers, long long dummy, long long dummy2, void *shp, void *dummyp)
+{
+    struct req_shared *sh = (struct req_shared *)shp;
+    struct latency_hist *prev;
+    uint64_t prev_done = 0, prev_busy = 0, prev_offered, prev_dropped;
+    uint64_t rng = rng_seed(), next, burst_end, last_report, now;
+    double rate = c_req_rate, on_rate, off_rate, on_fraction;
+    int bursting = 0, w;
+
+    prev = (struct latency_hist *)calloc(REQ_NLATENCIES, sizeof(*prev));
+    if (prev == NULL) {
+        perror("calloc");
+        _exit(1);
+    }
+    /* a restarted dispatcher reports from where the workers are now */
+    for (w = 0; w < nworkers; w++) {
+        int l, b;
+        prev_done += sh->stats[w].done;
+        prev_busy += sh->stats[w].busy_ns;
+        for (l = 0; l < REQ_NLATENCIES; l++)
+            for (b = 0; b < HIST_BUCKETS; b++)
+                prev[l].count[b] += sh->stats[w].hist[l].count[b];
+    }
+    prev_offered = sh->offered;
+    prev_dropped = sh->dropped;
+
+    req_burst_rates(&on_rate, &off_rate, &on_fraction);
+    if (c_req_arrival == REQ_ARRIVAL_BURSTY)
+        rate = off_rate;
+    say(2, "req_dispatch (%d): %ld requests/sec, %s arrivals\n", getpid(),
+           c_req_rate, req_arrival_names[c_req_arrival]);
+
+    next = last_report = now = mono_nsec();
+    burst_end = now + (uint64_t)rng_exponential(&rng,
+                          REQ_BURST_MEAN * (1 - on_fraction) / on_fraction);
+    while (1) {
+        int queued = 0;
+
+        if (next > now)
+            sleep_until_nsec(next);
+        now = mono_nsec();
+
+        /* everything due by now goes in at once; when the dispatcher
+         * oversleeps, those requests' queueing time includes it */
+        req_lock(sh);
+        while (next <= now) {
+            if (sh->head - sh->tail < REQ_QUEUE_LEN) {
+                struct req *r = &sh->queue[sh->head % REQ_QUEUE_LEN];
+                r->arrival = next;
+                r->cpu_iters = req_sample_iters(&rng);
+                sh->head++;
+                queued++;
+            } else {
+                sh->dropped++;
+            }
+            sh->offered++;
+
+            if (c_req_arrival == REQ_ARRIVAL_BURSTY && next >= burst_end) {
+                bursting = !bursting;
+                rate = bursting ? on_rate : off_rate;
+                burst_end = next + (uint64_t)rng_exponential(&rng,
+                    bursting ? REQ_BURST_MEAN :
+                               REQ_BURST_MEAN * (1 - on_fraction) / on_fraction);
+            }
+            next += (uint64_t)rng_exponential(&rng, 1e9 / rate);
+        }
+        if (queued > 1)
+            pthread_cond_broadcast(&sh->nonempty);
+        else if (queued)
+            pthread_cond_signal(&sh->nonempty);
+        pthread_mutex_unlock(&sh->lock);
+
+        if (c_stats_interval > 0 &&
+            now - last_report >= (uint64_t)c_stats_interval * 1000000000) {
+            req_report(sh, (int)nworkers, prev, &prev_done, &prev_busy,
+                       &prev_offered, &prev_dropped,
+                       (now - last_report) / 1e9);
+            last_report = now;
+        }
+        perf_sample();
+    }
+    _exit(1);
+}
+
+/* The interference probe: a cyclictest-style loop measuring what the load
+ * does to a latency-sensitive neighbour.  Each cycle it sleeps to an
+ * absolute deadline (wakeup latency), chases pointers through a buffer
+ * (memory latency), and takes a short relative sleep (timer overshoot).
+ * Results are kept per phase -- before the generators start, and while
+ * they run -- and compared when the probe is stopped.
+ */
+#define PROBE_SLEEP 100000 /* nsec; the relative sleep for timer overshoot */
+#define PROBE_CHASE 256    /* dependent loads per memory-latency sample */
+
+enum probe_metric {
+    PROBE_WAKEUP = 0,
+    PROBE_OVERSHOOT,
+    PROBE_MEMORY,
+    PROBE_NMETRICS
+};
+static const char *probe_metric_names[] = {
+    "wakeup", "overshoot", "memory"
+};
+static const char *probe_metric_units[] = {
+    "usec", "usec", "ns/load"
+};
+static const double probe_metric_scale[] = { 1e3, 1e3, 1 };
+
+enum probe_phase {
+    PROBE_BASELINE = 0,
+    PROBE_LOAD,
+    PROBE_NPHASES
+};
+static const char *probe_phase_names[] = { "baseline", "load" };
+
+static volatile sig_atomic_t probe_stop = 0;
+
+static void probe_on_signal(int sig)
+{
+    probe_stop = 1;
+}
+
+/* a random cyclic walk over the buffer's cache lines */
+static void **probe_chase_init(size_t sz, uint64_t *rng)
+{
+    size_t n = sz / CACHE_LINE, i;
+    char *buf;
+    size_t *order;
+
+    if (n < 2)
+        return NULL;
+    buf = (char *)malloc(n * CACHE_LINE);
+    order = (size_t *)malloc(n * sizeof(*order));
+    if (buf == NULL || order == NULL) {
+        perror("malloc");
+        _exit(1);
+    }
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    /* Sattolo's algorithm: a single cycle through every line */
+    for (i = n - 1; i > 0; i--) {
+        size_t j = rng_next(rng) % i, t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (i = 0; i < n; i++)
+        *(void **)(buf + order[i] * CACHE_LINE) =
+            buf + order[(i + 1) % n] * CACHE_LINE;
+    free(order);
+    return (void **)buf;
+}
+
+static void probe_summary(const struct latency_hist *h, uint64_t n,
+                          enum probe_metric m, char *buf, size_t sz)
+{
+    uint64_t maxv = 0;
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS; b++)
+        if (h->count[b])
+            maxv = hist_value(b);
+    snprintf(buf, sz, "p50 %.1f p99 %.1f p99.9 %.1f max %.1f",
+             hist_quantile(h, n, .5) / probe_metric_scale[m],
+             hist_quantile(h, n, .99) / probe_metric_scale[m],
+             hist_quantile(h, n, .999) / probe_metric_scale[m],
+             maxv / probe_metric_scale[m]);
+}
+
+static void probe_report_interval(enum probe_phase phase,
+                                  struct latency_hist *h, uint64_t *n)
+{
+    char s[PROBE_NMETRICS][128];
+    int m;
+
+    for (m = 0; m < PROBE_NMETRICS; m++) {
+        if (n[m] == 0)
+            strcpy(s[m], "n/a");
+        else
+            probe_summary(&h[m], n[m], (enum probe_metric)m, s[m],
+                          sizeof(s[m]));
+    }
+    say(1, "probe (%d): %s: wakeup %s usec; overshoot %s usec;"
+           " memory %s ns/load\n", getpid(), probe_phase_names[phase],
+           s[PROBE_WAKEUP], s[PROBE_OVERSHOOT], s[PROBE_MEMORY]);
+}
+
+/* baseline against load, metric by metric */
+static void probe_report_impact(struct latency_hist (*h)[PROBE_NMETRICS],
+                                uint64_t (*n)[PROBE_NMETRICS],
+                                const uint64_t *phase_ns)
+{
+    int m;
+
+    say(1, "probe (%d): impact report: %.0fs baseline, %.0fs under load\n",
+           getpid(), phase_ns[PROBE_BASELINE] / 1e9,
+           phase_ns[PROBE_LOAD] / 1e9);
+    for (m = 0; m < PROBE_NMETRICS; m++) {
+        char s[PROBE_NPHASES][128];
+        int p;
+
+        for (p = 0; p < PROBE_NPHASES; p++) {
+            if (n[p][m] == 0)
+                strcpy(s[p], "n/a");
+            else
+                probe_summary(&h[p][m], n[p][m], (enum probe_metric)m, s[p],
+                              sizeof(s[p]));
+        }
+        if (n[PROBE_BASELINE][m] > 0 && n[PROBE_LOAD][m] > 0) {
+            double b99 = hist_quantile(&h[PROBE_BASELINE][m],
+                                       n[PROBE_BASELINE][m], .99);
+            double l99 = hist_quantile(&h[PROBE_LOAD][m],
+                                       n[PROBE_LOAD][m], .99);
+            say(1, "probe (%d):   %s (%s): baseline %s; load %s;"
+                   " p99 x%.2f\n", getpid(), probe_metric_names[m],
+                   probe_metric_units[m], s[PROBE_BASELINE], s[PROBE_LOAD],
+                   b99 > 0 ? l99 / b99 : 0);
+        } else {
+            say(1, "probe (%d):   %s (%s): baseline %s; load %s\n", getpid(),
+                   probe_metric_names[m], probe_metric_units[m],
+                   s[PROBE_BASELINE], s[PROBE_LOAD]);
+        }
+    }
+}
+
+static void probe(long long load_start, long long dummy, long long dummy2, void *dummyp, void *dummyp2)
+{
+    struct latency_hist (*h)[PROBE_NMETRICS], *ih;
+    uint64_t n[PROBE_NPHASES][PROBE_NMETRICS], in[PROBE_NMETRICS];
+    uint64_t phase_ns[PROBE_NPHASES] = { 0, 0 };
+    const uint64_t interval = (uint64_t)c_probe_interval * 1000;
+    uint64_t rng = rng_seed(), next, now, last, last_report;
+    void **chase = NULL, **p = NULL;
+    struct sigaction sa;
+    enum probe_phase phase;
+    int i;
+
+    if (c_probe_cpu >= 0)
+        cpu_pin("probe", c_probe_cpu);
+    if (c_probe_fifo > 0) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = c_probe_fifo;
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) == -1)
+            err("probe (%d): couldn't set SCHED_FIFO priority %d: %s;"
+                " continuing at normal priority\n", getpid(), c_probe_fifo,
+                strerror(errno));
+        /* page faults would swamp what's being measured */
+        else if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            say(2, "probe (%d): mlockall: %s\n", getpid(), strerror(errno));
+    }
+    if (c_probe_mem > 0)
+        p = chase = probe_chase_init(c_probe_mem, &rng);
+
+    h = (struct latency_hist (*)[PROBE_NMETRICS])calloc(PROBE_NPHASES,
+                                                        sizeof(*h));
+    ih = (struct latency_hist *)calloc(PROBE_NMETRICS, sizeof(*ih));
+    if (h == NULL || ih == NULL) {
+        perror("calloc");
+        _exit(1);
+    }
+    memset(n, 0, sizeof(n));
+    memset(in, 0, sizeof(in));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = probe_on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    say(2, "probe (%d): probing every %ld usec\n", getpid(),
+           c_probe_interval);
+    next = last = last_report = mono_nsec();
+    phase = last >= (uint64_t)load_start ? PROBE_LOAD : PROBE_BASELINE;
+    while (! probe_stop) {
+        struct timespec ts;
+        uint64_t t0;
+
+        next += interval;
+        ts.tv_sec = next / 1000000000;
+        ts.tv_nsec = next % 1000000000;
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+            continue;
+        now = mono_nsec();
+        if (phase == PROBE_BASELINE && now >= (uint64_t)load_start) {
+            if (c_stats_interval > 0)
+                probe_report_interval(phase, ih, in);
+            phase_ns[phase] += now - last;
+            last = last_report = now;
+            phase = PROBE_LOAD;
+            memset(ih, 0, sizeof(*ih) * PROBE_NMETRICS);
+            memset(in, 0, sizeof(in));
+        }
+#define PROBE_RECORD(metric, v) do { \
+            int b_ = hist_bucket(v); \
+            h[phase][metric].count[b_]++; n[phase][metric]++; \
+            ih[metric].count[b_]++; in[metric]++; \
+        } while (0)
+        PROBE_RECORD(PROBE_WAKEUP, now - next);
+        if (now - next > interval)
+            next = now; /* overran a whole cycle; don't burst to catch up */
+
+        if (chase != NULL) {
+            t0 = mono_nsec();
+            for (i = 0; i < PROBE_CHASE; i++)
+                p = (void **)*p;
+            PROBE_RECORD(PROBE_MEMORY, (mono_nsec() - t0) / PROBE_CHASE);
+        }
+
+        t0 = mono_nsec();
+        ts.tv_sec = 0;
+        ts.tv_nsec = PROBE_SLEEP;
+        if (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL) == 0) {
+            uint64_t slept = mono_nsec() - t0;
+            PROBE_RECORD(PROBE_OVERSHOOT,
+                         slept > PROBE_SLEEP ? slept - PROBE_SLEEP : 0);
+        }
+#undef PROBE_RECORD
+
+        now = mono_nsec();
+        if (c_stats_interval > 0 &&
+            now - last_report >= (uint64_t)c_stats_interval * 1000000000) {
+            probe_report_interval(phase, ih, in);
+            memset(ih, 0, sizeof(*ih) * PROBE_NMETRICS);
+            memset(in, 0, sizeof(in));
+            last_report = now;
+        }
+        perf_sample();
+    }
+    phase_ns[phase] += mono_nsec() - last;
+    /* keep the chase from being optimized away */
+    if (chase != NULL && p == NULL)
+        say(3, "probe (%d): lost the chase\n", getpid());
+    probe_report_impact(h, n, phase_ns);
+    exit(0);
+}
+
+/* Allocation churn: threads of one process -- threads, so that they share
+ * an address space and its mmap_lock -- malloc()ing and free()ing, mapping
+ * and unmapping, and faulting pages in, each at a target rate.  Unmapping
+ * and MADV_DONTNEED in a multithreaded process cost a TLB shootdown on
+ * every CPU the process's other threads are running on.
+ */
+#define CHURN_LIVE 4096          /* live allocations per thread */
+#define CHURN_FAULT_PAGES 64     /* per thread, refaulted in rotation */
+#define CHURN_TICK 1000000ULL    /* nsec */
+
+enum churn_op {
+    CHURN_ALLOC = 0,
+    CHURN_MMAP,
+    CHURN_FAULT,
+    CHURN_NOPS
+};
+
+struct churn_thread {
+    int index;
+    int nthreads;
+    uint64_t ops[CHURN_NOPS] __attribute__((aligned(CACHE_LINE)));
+    uint64_t mmap_ns;            /* time spent in mmap/touch/munmap */
+};
+
+/* Ops due by now, done of them done so far, at rate per second since
+ * elapsed nsec ago.  No more than a second's worth is caught up on at
+ * once, but always at least one, however low the rate.
+ */
+static uint64_t rate_due(double rate, uint64_t elapsed, uint64_t done)
+{
+    double due = rate * elapsed / 1e9;
+
+    if (rate <= 0 || due <= done)
+        return 0;
+    if (due - done > rate)
+        return rate < 1 ? 1 : (uint64_t)ceil(rate);
+    return (uint64_t)(due - done);
+}
+
+/* ops of this kind due by now, for one thread */
+static uint64_t churn_due(long rate, int nthreads, uint64_t elapsed,
+                          uint64_t done)
+{
+    return rate_due((double)rate / nthreads, elapsed, done);
+}
+
+static void *churn_thread_main(void *arg)
+{
+    struct churn_thread *t = (struct churn_thread *)arg;
+    const size_t pagesize = LB_PAGE_SIZE;
+    size_t mmap_size = (c_mmap_size + pagesize - 1) / pagesize * pagesize;
+    uint64_t rng = rng_seed() ^ ((uint64_t)t->index << 48);
+    uint64_t start, next, done[CHURN_NOPS] = { 0, 0, 0 };
+    void **live;
+    char *fault_region = NULL;
+    size_t live_i = 0, fault_i = 0;
+
+    if ((live = (void **)calloc(CHURN_LIVE, sizeof(*live))) == NULL) {
+        perror("calloc");
+        _exit(1);
+    }
+    if (c_fault_rate > 0) {
+        fault_region = (char *)mmap(NULL, CHURN_FAULT_PAGES * pagesize,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (fault_region == MAP_FAILED) {
+            perror("mmap");
+            _exit(1);
+        }
+    }
+
+    start = next = mono_nsec();
+    while (1) {
+        uint64_t now = mono_nsec(), n, i;
+
+        n = churn_due(c_alloc_rate, t->nthreads, now - start,
+                      done[CHURN_ALLOC]);
+        for (i = 0; i < n; i++) {
+            size_t sz = (size_t)rng_sample(&rng, c_alloc_size_dist,
+                                           c_alloc_size);
+            char *p;
+
+            if (sz == 0)
+                sz = 1;
+            /* replace a random live allocation, so lifetimes vary and
+             * the allocator sees frees out of order */
+            live_i = rng_next(&rng) % CHURN_LIVE;
+            free(live[live_i]);
+            if ((p = (char *)malloc(sz)) != NULL) {
+                size_t off;
+                for (off = 0; off < sz; off += pagesize)
+                    p[off] = (char)off;
+                p[sz - 1] = 1;
+            }
+            live[live_i] = p;
+        }
+        done[CHURN_ALLOC] += n;
+
+        n = churn_due(c_mmap_rate, t->nthreads, now - start,
+                      done[CHURN_MMAP]);
+        for (i = 0; i < n; i++) {
+            uint64_t t0 = mono_nsec();
+            char *p = (char *)mmap(NULL, mmap_size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            size_t off;
+
+            if (p == MAP_FAILED) {
+                perror("mmap");
+                _exit(1);
+            }
+            for (off = 0; off < mmap_size; off += pagesize)
+                p[off] = 1;
+            munmap(p, mmap_size);
+            t->mmap_ns += mono_nsec() - t0;
+        }
+        done[CHURN_MMAP] += n;
+
+        n = churn_due(c_fault_rate, t->nthreads, now - start,
+                      done[CHURN_FAULT]);
+        for (i = 0; i < n; i++) {
+            /* once every page has been faulted in, drop them all again */
+            if (fault_i == CHURN_FAULT_PAGES) {
+                madvise(fault_region, CHURN_FAULT_PAGES * pagesize,
+                        MADV_DONTNEED);
+                fault_i = 0;
+            }
+            fault_region[fault_i++ * pagesize] = 1;
+        }
+        done[CHURN_FAULT] += n;
+
+        for (i = 0; i < CHURN_NOPS; i++)
+            __atomic_store_n(&t->ops[i], done[i], __ATOMIC_RELAXED);
+        next += CHURN_TICK;
+        if (next < mono_nsec())
+            next = mono_nsec(); /* behind; churn_due() does the catching up */
+        else
+            sleep_until_nsec(next);
+    }
+    return NULL;
+}
+
+static void churn(long long nthreads, long long dummy, long long dummy2, void *dummyp, void *dummyp2)
+{
+    struct churn_thread *threads;
+    uint64_t prev[CHURN_NOPS] = { 0, 0, 0 }, prev_ns = 0, last;
+    struct rusage ru, last_ru;
+    int i;
+
+    threads = (struct churn_thread *)calloc(nthreads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("calloc");
+        _exit(1);
+    }
+    say(2, "churn (%d): starting %lld thread(s)\n", getpid(), nthreads);
+    for (i = 0; i < nthreads; i++) {
+        pthread_t tid;
+        int e;
+
+        threads[i].index = i;
+        threads[i].nthreads = (int)nthreads;
+        if ((e = pthread_create(&tid, NULL, churn_thread_main,
+                                &threads[i])) != 0) {
+            err("churn (%d): pthread_create: %s\n", getpid(), strerror(e));
+            _exit(1);
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &last_ru);
+    last = mono_nsec();
+    while (1) {
+        uint64_t ops[CHURN_NOPS] = { 0, 0, 0 }, ns = 0, now;
+        double secs;
+        int op;
+
+        if (c_stats_interval > 0)
+            sleep_until_nsec(last + (uint64_t)c_stats_interval * 1000000000);
+        else
+            pause();
+        now = mono_nsec();
+        secs = (now - last) / 1e9;
+        for (i = 0; i < nthreads; i++) {
+            for (op = 0; op < CHURN_NOPS; op++)
+                ops[op] += __atomic_load_n(&threads[i].ops[op],
+                                           __ATOMIC_RELAXED);
+            ns += threads[i].mmap_ns;
+        }
+        getrusage(RUSAGE_SELF, &ru);
+        say(1, "churn (%d): %.0f allocs/sec (target %ld), %.0f mmap cycles/sec"
+               " (target %ld, %.1f usec each), %.0f page faults/sec (%ld"
+               " targeted, the rest from allocation); %.0f involuntary"
+               " switches/sec\n", getpid(),
+               (ops[CHURN_ALLOC] - prev[CHURN_ALLOC]) / secs, c_alloc_rate,
+               (ops[CHURN_MMAP] - prev[CHURN_MMAP]) / secs, c_mmap_rate,
+               ops[CHURN_MMAP] > prev[CHURN_MMAP] ?
+                   (ns - prev_ns) / 1e3 / (ops[CHURN_MMAP] - prev[CHURN_MMAP]) :
+                   0.,
+               (ru.ru_minflt - last_ru.ru_minflt) / secs, c_fault_rate,
+               (ru.ru_nivcsw - last_ru.ru_nivcsw) / secs);
+        memcpy(prev, ops, sizeof(prev));
+        prev_ns = ns;
+        last_ru = ru;
+        last = now;
+        perf_sample();
+    }
+    _exit(1);
+}
+
+/* Create a data file of sz bytes in the first disk path's directory (or
+ * /tmp), unlinked at once so that it disappears with its last user.  It is
+ * written out, not sparse, so that reads of it reach the device.  Returns
+ * the open descriptor; what names the file in errors.
+ */
+static int make_data_file(const char *what, off_t sz)
+{
+    const char *dir = c_disk_churn_paths_n > 0 ? c_disk_churn_paths[0] :
+                                                 "/tmp";
+    char *tmpl = (char *)malloc(strlen(dir) + 32), *chunk;
+    struct stat st;
+    off_t off;
+    size_t n;
+    int fd;
+
+    if (tmpl == NULL || (chunk = (char *)malloc(1024 * 1024)) == NULL) {
+        perror("malloc");
+        shut_down();
+    }
+    strcpy(tmpl, dir);
+    if (stat(tmpl, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        char *slash = strrchr(tmpl, '/');
+        if (slash == NULL)
+            strcpy(tmpl, ".");
+        else if (slash == tmpl)
+            tmpl[1] = '\0';
+        else
+            *slash = '\0';
+    }
+    sprintf(tmpl + strlen(tmpl), "/lb.%d.XXXXXX", getpid());
+    if ((fd = mkstemp(tmpl)) == -1) {
+        err("Couldn't create %s %s: %s\n", what, tmpl, strerror(errno));
+        shut_down();
+    }
+    unlink(tmpl);
+    memset(chunk, 0x5a, 1024 * 1024);
+    for (off = 0; off < sz; off += n) {
+        n = sz - off < 1024 * 1024 ? (size_t)(sz - off) : 1024 * 1024;
+        if (pwrite(fd, chunk, n, off) == -1) {
+            err("Couldn't write %s: %s\n", what, strerror(errno));
+            shut_down();
+        }
+    }
+    fdatasync(fd);
+    free(chunk);
+    free(tmpl);
+    return fd;
+}
+
+/* Page-cache occupancy: keep sz bytes of a data file resident in the page
+ * cache.  Residency is measured with mincore() over a mapping of the file;
+ * pages which have been evicted are read back in (announced first with
+ * POSIX_FADV_WILLNEED, so that they come in as large reads), and resident
+ * pages are referenced through the mapping each tick, so that reclaim sees
+ * them as in use and takes other files' pages first.
+ */
+#define CACHE_TICK 250000000ULL /* nsec */
+#define CACHE_READ_CHUNK (1024 * 1024)
+
+static void cache_fill(long long fd, long long asz, long long dummy, void *dummyp, void *dummyp2)
+{
+    const size_t pagesize = LB_PAGE_SIZE;
+    const size_t sz = (size_t)asz, npages = (sz + pagesize - 1) / pagesize;
+    uint64_t next = mono_nsec(), next_report = 0, refilled = 0;
+    uint64_t res_sum = 0, nticks = 0;
+    unsigned char *vec;
+    char *map, *chunk;
+
+    map = (char *)mmap(NULL, sz, PROT_READ, MAP_SHARED, (int)fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        _exit(1);
+    }
+    if ((vec = (unsigned char *)malloc(npages)) == NULL ||
+        (chunk = (char *)malloc(CACHE_READ_CHUNK)) == NULL) {
+        perror("malloc");
+        _exit(1);
+    }
+    say(1, "cache (%d): keeping %llu bytes in the page cache\n", getpid(),
+           (unsigned long long)sz);
+
+    while (1) {
+        size_t i, resident = 0, run;
+        volatile char sink;
+        uint64_t now;
+
+        if (mincore(map, sz, vec) == -1) {
+            perror("mincore");
+            _exit(1);
+        }
+        for (i = 0; i < npages; i += run) {
+            for (run = 0; i + run < npages && !(vec[i + run] & 1); run++)
+                ;
+            if (run == 0) {
+                sink = map[i * pagesize];
+                resident++;
+                run = 1;
+                continue;
+            }
+            /* evicted: read the run back in */
+            {
+                off_t off = (off_t)i * pagesize, end = (off_t)(i + run) * pagesize;
+                ssize_t r;
+
+                if (end > (off_t)sz)
+                    end = (off_t)sz;
+                posix_fadvise((int)fd, off, end - off, POSIX_FADV_WILLNEED);
+                while (off < end) {
+                    size_t n = end - off < CACHE_READ_CHUNK ?
+                               (size_t)(end - off) : CACHE_READ_CHUNK;
+                    if ((r = pread((int)fd, chunk, n, off)) <= 0) {
+                        err("cache (%d): read: %s\n", getpid(),
+                            r == 0 ? "unexpected EOF" : strerror(errno));
+                        _exit(1);
+                    }
+                    off += r;
+                    refilled += r;
+                }
+            }
+        }
+        (void)sink;
+        res_sum += resident;
+        nticks++;
+
+        now = mono_nsec();
+        if (c_stats_interval > 0 && now >= next_report) {
+            if (next_report != 0) {
+                double secs = (now - next_report) / 1e9 + c_stats_interval;
+                say(1, "cache (%d): %.0f%% of %llu KB resident on average,"
+                       " %.0f KB/sec read back after eviction\n", getpid(),
+                       100. * res_sum / nticks / npages,
+                       (unsigned long long)sz / 1024,
+                       refilled / 1024. / secs);
+            }
+            res_sum = nticks = refilled = 0;
+            next_report = now + (uint64_t)c_stats_interval * 1000000000;
+        }
+        perf_sample();
+        next += CACHE_TICK;
+        if (next < mono_nsec())
+            next = mono_nsec();
+        else
+            sleep_until_nsec(next);
+    }
+    _exit(1);
+}
+
+/* Network load: flows of TCP or UDP messages over loopback, each between
+ * a sender and an echo server in processes of their own, so that the
+ * traffic crosses the whole stack (including softirq processing) on both
+ * sides.  Every message starts with a header carrying its send time; the
+ * server answers each complete message with the header alone, and the
+ * sender measures the round trip.  Connection churn opens, uses and closes
+ * a fresh TCP connection per operation.
+ */
+#define NET_TICK 1000000ULL     /* nsec */
+#define NET_MAX_CONNS 65536     /* server connection slots, by fd */
+#define NET_RECV_BUF (256 * 1024)
+#define NET_UDP_MAX 65507
+#define NET_OUT_HDRS 32         /* replies a server connection may queue */
+
+struct net_hdr {
+    uint64_t sent;              /* mono_nsec() */
+    uint64_t seq;
+};
+
+struct net_conn {
+    size_t got;                 /* bytes of the current message so far */
+    struct net_hdr hdr;
+    /* replies the socket hasn't taken yet; a reply is queued whole or not
+     * at all, so that the stream of headers stays aligned */
+    size_t out_len;
+    char out[NET_OUT_HDRS * sizeof(struct net_hdr)];
+    int want_out;               /* polling for EPOLLOUT */
+};
+
+static size_t net_msg_size()
+{
+    if (c_net_msg_size > 0)
+        return c_net_msg_size;
+    return c_net_proto == NET_PROTO_UDP ? 1400 : 16384;
+}
+
+static void net_nodelay(int fd)
+{
+    int one = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* send what a server connection has queued, waiting for EPOLLOUT if the
+ * socket won't take it all; returns -1 if the connection has failed */
+static int net_flush(int ep, int fd, struct net_conn *cn)
+{
+    struct epoll_event ev;
+    ssize_t r;
+
+    while (cn->out_len > 0) {
+        r = send(fd, cn->out, cn->out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r == -1 && errno != EAGAIN)
+            return -1;
+        if (r <= 0)
+            break;
+        memmove(cn->out, cn->out + r, cn->out_len - r);
+        cn->out_len -= r;
+    }
+    if ((cn->out_len > 0) != cn->want_out) {
+        cn->want_out = cn->out_len > 0;
+        ev.events = cn->want_out ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+    }
+    return 0;
+}
+
+/* The echo server for one flow: accepts connections on the flow's TCP
+ * listener, and answers each whole message, on those or on the UDP socket,
+ * with its header.  It never blocks on a reply, so that a sender busy
+ * sending can't deadlock against it: a TCP connection's replies which the
+ * socket won't take yet wait, whole, in its queue of NET_OUT_HDRS until
+ * EPOLLOUT lets net_flush() send them, and only beyond that are dropped.
+ * A UDP reply which would block is dropped.
+ */
+static void net_server(long long index, long long lfd, long long ufd, void *dummyp, void *dummyp2)
+{
+    const size_t msg = net_msg_size();
+    struct net_conn *conns;
+    struct epoll_event ev, evs[64];
+    char *buf;
+    int ep, i, n;
+
+    conns = (struct net_conn *)calloc(NET_MAX_CONNS, sizeof(*conns));
+    buf = (char *)malloc(NET_RECV_BUF);
+    if (conns == NULL || buf == NULL) {
+        perror("malloc");
+        _exit(1);
+    }
+    if ((ep = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        _exit(1);
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = (int)lfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, (int)lfd, &ev);
+    if (ufd >= 0) {
+        ev.data.fd = (int)ufd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, (int)ufd, &ev);
+    }
+    say(2, "net_server (%d): flow %lld ready\n", getpid(), index);
+
+    while (1) {
+        if ((n = epoll_wait(ep, evs, 64, -1)) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            _exit(1);
+        }
+        for (i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            ssize_t r;
+
+            if (fd == (int)lfd) {
+                int c = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (c == -1)
+                    continue;
+                if (c >= NET_MAX_CONNS) {
+                    close(c);
+                    continue;
+                }
+                net_nodelay(c);
+                conns[c].got = 0;
+                conns[c].out_len = 0;
+                conns[c].want_out = 0;
+                ev.events = EPOLLIN;
+                ev.data.fd = c;
+                epoll_ctl(ep, EPOLL_CTL_ADD, c, &ev);
+            } else if (fd == (int)ufd) {
+                struct sockaddr_storage from;
+                socklen_t fromlen;
+
+                while (1) {
+                    fromlen = sizeof(from);
+                    r = recvfrom(fd, buf, NET_RECV_BUF, MSG_DONTWAIT,
+                                 (struct sockaddr *)&from, &fromlen);
+                    if (r < (ssize_t)sizeof(struct net_hdr))
+                        break;
+                    sendto(fd, buf, sizeof(struct net_hdr), MSG_DONTWAIT,
+                           (struct sockaddr *)&from, fromlen);
+                }
+            } else {
+                struct net_conn *cn = &conns[fd];
+                size_t off = 0;
+
+                if ((evs[i].events & EPOLLOUT) && net_flush(ep, fd, cn) == -1) {
+                    close(fd);
+                    continue;
+                }
+                if (! (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                    continue;
+                r = recv(fd, buf, NET_RECV_BUF, MSG_DONTWAIT);
+                if (r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR)) {
+                    close(fd); /* leaves the epoll set with it */
+                    continue;
+                }
+                while (r > 0 && off < (size_t)r) {
+                    size_t take = msg - cn->got;
+
+                    if (take > (size_t)r - off)
+                        take = (size_t)r - off;
+                    if (cn->got < sizeof(cn->hdr)) {
+                        size_t h = sizeof(cn->hdr) - cn->got;
+                        memcpy((char *)&cn->hdr + cn->got, buf + off,
+                               h < take ? h : take);
+                    }
+                    cn->got += take;
+                    off += take;
+                    if (cn->got == msg) {
+                        /* with the queue full, the reply is dropped */
+                        if (cn->out_len + sizeof(cn->hdr) <= sizeof(cn->out)) {
+                            memcpy(cn->out + cn->out_len, &cn->hdr,
+                                   sizeof(cn->hdr));
+                            cn->out_len += sizeof(cn->hdr);
+                        }
+                        cn->got = 0;
+                    }
+                }
+                if (cn->out_len > 0 && net_flush(ep, fd, cn) == -1)
+                    close(fd);
+            }
+        }
+    }
+    _exit(1);
+}
+
+/* collect send completions for MSG_ZEROCOPY; counts those completed, and
+ * those for which the kernel had to copy after all (as it always does over
+ * loopback) */
+static void net_zerocopy_reap(int fd, uint64_t *done, uint64_t *copied)
+{
+#ifdef NET_ZEROCOPY
+    char control[128];
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    struct sock_extended_err *ee;
+
+    while (1) {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            return;
+        for (cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+            ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            /* ee_info..ee_data is the range of sends completed */
+            *done += ee->ee_data - ee->ee_info + 1;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                *copied += ee->ee_data - ee->ee_info + 1;
+        }
+    }
+#endif
+}
+
+static int net_connect(int type, struct sockaddr_in *sa)
+{
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+
+    if (fd == -1 || connect(fd, (struct sockaddr *)sa, sizeof(*sa)) == -1) {
+        err("net (%d): couldn't connect to port %d: %s\n", getpid(),
+            ntohs(sa->sin_port), strerror(errno));
+        _exit(1);
+    }
+    if (type == SOCK_STREAM)
+        net_nodelay(fd);
+    return fd;
+}
+
+/* Round trips measured by a sender, from the replies on its socket */
+struct net_rtt {
+    char buf[NET_RECV_BUF / 16];
+    size_t got;
+    struct latency_hist hist;
+    uint64_t max, n;
+};
+
+static void net_replies(int fd, struct net_rtt *rt)
+{
+    ssize_t r;
+
+    while ((r = recv(fd, rt->buf + rt->got, sizeof(rt->buf) - rt->got,
+                     MSG_DONTWAIT)) > 0) {
+        uint64_t now = mono_nsec();
+        size_t off;
+
+        rt->got += r;
+        for (off = 0; off + sizeof(struct net_hdr) <= rt->got;
+             off += sizeof(struct net_hdr)) {
+            struct net_hdr h;
+
+            memcpy(&h, rt->buf + off, sizeof(h));
+            rt->hist.count[hist_bucket(now - h.sent)]++;
+            if (now - h.sent > rt->max)
+                rt->max = now - h.sent;
+            rt->n++;
+        }
+        memmove(rt->buf, rt->buf + off, rt->got - off);
+        rt->got -= off;
+    }
+}
+
+/* sleep until t, taking replies as they arrive so that their round trips
+ * aren't stretched by the sender's own sleep */
+static void net_wait(int fd, struct net_rtt *rt, uint64_t t)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    uint64_t now;
+
+    if (fd == -1) {
+        sleep_until_nsec(t);
+        return;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while ((now = mono_nsec()) < t) {
+        ts.tv_sec = (t - now) / 1000000000;
+        ts.tv_nsec = (t - now) % 1000000000;
+        if (ppoll(&pfd, 1, &ts, NULL) > 0)
+            net_replies(fd, rt);
+    }
+}
+
+/* The sender for one flow: messages over a persistent TCP connection or
+ * connected UDP socket at its share of the message rate (or as fast as it
+ * can, with no rate set), and its share of the TCP connection rate.
+ */
+static void net_client(long long index, long long port, long long uport, void *dummyp, void *dummyp2)
+{
+    const size_t msg = net_msg_size();
+    const int nflows = c_net_flows;
+    double msg_rate = 0, conn_rate = (double)c_net_conn_rate / nflows;
+    struct sockaddr_in sa;
+    struct net_rtt *rtt;
+    struct latency_hist *conn_lat;
+    uint64_t seq = 0, sent = 0, sent_bytes = 0, conns = 0;
+    uint64_t zc_done = 0, zc_copied = 0, zc_prev = 0, zc_prev_copied = 0;
+    uint64_t prev_sent = 0, prev_bytes = 0, prev_replies = 0, prev_conns = 0;
+    uint64_t conn_max = 0, start, next, last_report;
+    int fd = -1, flags = MSG_NOSIGNAL, zerocopy = 0, type;
+    char *buf;
+
+    if (c_net_bandwidth > 0)
+        msg_rate = (double)c_net_bandwidth / msg / nflows;
+    else if (c_net_msg_rate > 0)
+        msg_rate = (double)c_net_msg_rate / nflows;
+    rtt = (struct net_rtt *)calloc(1, sizeof(*rtt));
+    conn_lat = (struct latency_hist *)calloc(1, sizeof(*conn_lat));
+    if (rtt == NULL || conn_lat == NULL ||
+        (buf = (char *)malloc(msg)) == NULL) {
+        perror("malloc");
+        _exit(1);
+    }
+    memset(buf, 0x5a, msg);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons((uint16_t)port);
+
+    type = c_net_proto == NET_PROTO_UDP ? SOCK_DGRAM : SOCK_STREAM;
+    if (type == SOCK_DGRAM)
+        sa.sin_port = htons((uint16_t)uport);
+    if (c_net_bandwidth > 0 || c_net_msg_rate > 0 || c_net_conn_rate == 0) {
+        fd = net_connect(type, &sa);
+#ifdef NET_ZEROCOPY
+        if (c_net_zerocopy) {
+            int one = 1;
+            if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one,
+                           sizeof(one)) == -1) {
+                err("net (%d): SO_ZEROCOPY: %s\n", getpid(), strerror(errno));
+                _exit(1);
+            }
+            flags |= MSG_ZEROCOPY;
+            zerocopy = 1;
+        }
+#endif
+    }
+    sa.sin_port = htons((uint16_t)port);
+    say(2, "net (%d): flow %lld sending %zu-byte %s messages\n", getpid(),
+           index, msg, net_proto_names[c_net_proto]);
+
+    start = next = last_report = mono_nsec();
+    while (1) {
+        uint64_t now = mono_nsec(), n, i;
+        ssize_t r;
+
+        if (fd != -1) {
+            n = msg_rate > 0 ? rate_due(msg_rate, now - start, sent) : 64;
+            for (i = 0; i < n; i++) {
+                struct net_hdr h;
+
+                h.sent = mono_nsec();
+                h.seq = seq++;
+                memcpy(buf, &h, sizeof(h));
+                if ((r = send(fd, buf, msg, flags)) == -1) {
+                    if (errno == ENOBUFS || errno == EINTR)
+                        continue; /* zerocopy completions backed up */
+                    err("net (%d): send: %s\n", getpid(), strerror(errno));
+                    _exit(1);
+                }
+                sent++;
+                sent_bytes += r;
+                /* a stream may take only part; finish the message */
+                while ((size_t)r < msg && type == SOCK_STREAM) {
+                    ssize_t m = send(fd, buf + r, msg - r, flags);
+                    if (m == -1 && errno != EINTR && errno != ENOBUFS) {
+                        err("net (%d): send: %s\n", getpid(), strerror(errno));
+                        _exit(1);
+                    }
+                    if (m > 0) {
+                        r += m;
+                        sent_bytes += m;
+                    }
+                }
+            }
+            net_replies(fd, rtt);
+            if (zerocopy)
+                net_zerocopy_reap(fd, &zc_done, &zc_copied);
+        }
+
+        n = conn_rate > 0 ? rate_due(conn_rate, now - start, conns) : 0;
+        for (i = 0; i < n; i++) {
+            uint64_t t0 = mono_nsec();
+            int cfd = net_connect(SOCK_STREAM, &sa);
+            struct net_hdr h;
+            size_t off = 0;
+
+            h.sent = t0;
+            h.seq = seq++;
+            memcpy(buf, &h, sizeof(h));
+            while (off < msg) {
+                if ((r = send(cfd, buf + off, msg - off, MSG_NOSIGNAL)) <= 0)
+                    break;
+                off += r;
+            }
+            off = 0;
+            while (off < sizeof(h) &&
+                   (r = recv(cfd, (char *)&h + off, sizeof(h) - off, 0)) > 0)
+                off += r;
+            close(cfd);
+            t0 = mono_nsec() - t0;
+            conn_lat->count[hist_bucket(t0)]++;
+            if (t0 > conn_max)
+                conn_max = t0;
+            conns++;
+        }
+
+        now = mono_nsec();
+        if (c_stats_interval > 0 &&
+            now - last_report >= (uint64_t)c_stats_interval * 1000000000) {
+            double secs = (now - last_report) / 1e9;
+            uint64_t nr = rtt->n - prev_replies, nc = conns - prev_conns;
+
+            if (fd != -1)
+                say(1, "net (%d): flow %lld: %.1f MB/sec, %.0f msgs/sec"
+                       " (%.0f replies/sec); round trip in usec: p50 %.1f"
+                       " p99 %.1f p99.9 %.1f max %.1f\n", getpid(), index,
+                       (sent_bytes - prev_bytes) / secs / 1048576,
+                       (sent - prev_sent) / secs, nr / secs,
+                       hist_quantile(&rtt->hist, nr, .5) / 1e3,
+                       hist_quantile(&rtt->hist, nr, .99) / 1e3,
+                       hist_quantile(&rtt->hist, nr, .999) / 1e3,
+                       rtt->max / 1e3);
+            if (conn_rate > 0)
+                say(1, "net (%d): flow %lld: %.0f connections/sec;"
+                       " connection in usec: p50 %.1f p99 %.1f max %.1f\n",
+                       getpid(), index, nc / secs,
+                       hist_quantile(conn_lat, nc, .5) / 1e3,
+                       hist_quantile(conn_lat, nc, .99) / 1e3,
+                       conn_max / 1e3);
+            if (zerocopy)
+                say(1, "net (%d): flow %lld: %llu zerocopy sends completed,"
+                       " %llu of them copied\n", getpid(), index,
+                       (unsigned long long)(zc_done - zc_prev),
+                       (unsigned long long)(zc_copied - zc_prev_copied));
+            memset(&rtt->hist, 0, sizeof(rtt->hist));
+            memset(conn_lat, 0, sizeof(*conn_lat));
+            rtt->max = conn_max = 0;
+            prev_sent = sent;
+            prev_bytes = sent_bytes;
+            prev_replies = rtt->n;
+            prev_conns = conns;
+            zc_prev = zc_done;
+            zc_prev_copied = zc_copied;
+            last_report = now;
+        }
+        perf_sample();
+
+        if (msg_rate > 0 || fd == -1) {
+            next += NET_TICK;
+            if (next < mono_nsec())
+                next = mono_nsec();
+            else
+                net_wait(fd, rtt, next);
+        }
+    }
+    _exit(1);
+}
+
+static void worker_spawn(struct worker *w)
+{
+    pid_t p;
+
+    fflush(stdout);
+    p = fork();
+    if (p == -1) {
+        perror("fork");
+        exit_status = 1;
+        shut_down();
+    }
+    else if (p == 0) {
+        size_t i;
+        for (i = 0; i < n_workers; i++) {
+            if (workers[i].pidfd != -1)
+                close(workers[i].pidfd);
+        }
+        n_workers = 0;
+        if (sup_epfd != -1) {
+            close(sup_epfd);
+            close(sup_sigfd);
+            sup_epfd = sup_sigfd = -1;
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &sup_oldmask, NULL);
+        if (c_perf && perf_available)
+            perf_open(w->desc);
+        (*w->fn)(w->arg1, w->arg2, w->arg3, w->argP, w->argP2);
+        exit(0);
+    } else {
+        w->pid = p;
+        w->pidfd = -1;
+#ifdef SYS_pidfd_open
+        if (sup_epfd != -1 &&
+            (w->pidfd = (int)syscall(SYS_pidfd_open, p, 0)) != -1) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = (uint32_t)(w - workers);
+            if (epoll_ctl(sup_epfd, EPOLL_CTL_ADD, w->pidfd, &ev) == -1) {
+                close(w->pidfd);
+                w->pidfd = -1;
+            }
+        }
+#endif
+        say(1, "lookbusy (%d): %s started, PID %d\n", getpid(), w->desc, p);
+    }
+}
+
+static struct worker *fork_and_call(char *desc, spinner_fn fn, long long arg1, long long arg2, long long arg3, void *argP, void *argP2)
+{
+    static size_t cap;
+    struct worker *w;
+
+    if (n_workers == cap) {
+        size_t newcap = cap ? cap * 2 : 16;
+        struct worker *tmp = (struct worker *)realloc(workers,
+                                                      newcap * sizeof(*tmp));
+        if (tmp == NULL) {
+            perror("realloc");
+            exit_status = 1;
+            shut_down();
+        }
+        workers = tmp;
+        cap = newcap;
+    }
+    w = &workers[n_workers++];
+    memset(w, 0, sizeof(*w));
+    w->pidfd = -1;
+    if ((w->desc = strdup(desc)) == NULL) {
+        perror("strdup");
+        exit_status = 1;
+        shut_down();
+    }
+    w->fn = fn;
+    w->arg1 = arg1;
+    w->arg2 = arg2;
+    w->arg3 = arg3;
+    w->argP = argP;
+    w->argP2 = argP2;
+    w->restartable = 1;
+    worker_spawn(w);
+    return w;
+}
+
+/* Take over SIGCHLD, SIGTERM and SIGINT for the supervisor loop, before any
+ * workers exist to die.  Workers get the original mask back.
+ */
+static void supervise_init()
+{
+    struct epoll_event ev;
+    struct rlimit rl;
+    sigset_t set;
+
+    /* a pidfd per worker can add up */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    if (sigprocmask(SIG_BLOCK, &set, &sup_oldmask) == -1) {
+        perror("sigprocmask");
+        exit(1);
+    }
+    if ((sup_sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        perror("signalfd");
+        exit(1);
+    }
+    if ((sup_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = SUP_EV_SIGNAL;
+    if (epoll_ctl(sup_epfd, EPOLL_CTL_ADD, sup_sigfd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+/* A worker has gone: start it again if policy allows, otherwise say who
+ * and why, and bring everything else down. */
+static void supervise_exited(struct worker *w, pid_t pid, int status)
+{
+    int failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    char fate[128];
+
+    worker_fate(status, fate, sizeof(fate));
+    if (w->restartable &&
+        (c_restart == RESTART_ALWAYS ||
+         (c_restart == RESTART_ON_FAILURE && failed))) {
+        if (w->restarts < c_restart_limit) {
+            w->restarts++;
+            err("%s (PID %d) %s; restarting (%d of %d)\n", w->desc, pid,
+                fate, w->restarts, c_restart_limit);
+            worker_spawn(w);
+            return;
+        }
+        err("%s (PID %d) %s, and has been restarted %d times; giving up\n",
+            w->desc, pid, fate, w->restarts);
+    } else {
+        err("%s (PID %d) %s\n", w->desc, pid, fate);
+    }
+    /* a worker finishing cleanly still ends the run, but isn't an error */
+    if (failed)
+        exit_status = 1;
+    shut_down();
+}
+
+/* One round of supervision: wait up to timeout msec for a signal or a
+ * worker's exit, and deal with whatever arrives.  Returns the number of
+ * events, 0 if the wait timed out.
+ */
+static int supervise_once(int timeout)
+{
+    struct epoll_event ev[64];
+    int n, i, status;
+    pid_t pid;
+
+    n = epoll_wait(sup_epfd, ev, 64, timeout);
+    if (n == -1 && errno != EINTR) {
+        perror("epoll_wait");
+        exit_status = 1;
+        shut_down();
+    }
+    for (i = 0; i < n; i++) {
+        int sig;
+        if (ev[i].data.u32 == SUP_EV_SIGNAL &&
+            (sig = supervise_drain_signals()) != 0) {
+            say(1, "lookbusy (%d): caught signal %d (%s), shutting down\n",
+                   getpid(), sig, strsignal(sig));
+            shut_down();
+        }
+    }
+    /* whichever source woke us, a pidfd or SIGCHLD, reap everything */
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        struct worker *w = worker_reaped(pid);
+        if (w != NULL)
+            supervise_exited(w, pid, status);
+    }
+    return n > 0 ? n : 0;
+}
+
+static void supervise()
+{
+    while (1) {
+        if (supervise_once(1000) == 0)
+            say(2, "lookbusy (%d): waiting for spinners...\n", getpid());
+    }
+}
+
+/* Supervise, as supervise() does, until time t. */
+static void supervise_until(uint64_t t)
+{
+    uint64_t now;
+
+    while ((now = mono_nsec()) < t)
+        supervise_once((int)((t - now) / 1000000) + 1);
+}
+
+/* The CPU, disk and memory loads are liblookbusy's generators, with host
+ * scope; each of a generator's workers is forked and supervised like any
+ * other, and runs lb_run() until killed.
+ */
+static void gen_worker(long long index, long long dummy, long long dummy2,
+                       void *genv, void *dummyp)
+{
+    if (lb_run((lb_gen *)genv, (int)index) != 0)
+        exit(1);
+}
+
+static lb_gen *gen_create(const char *what, struct lb_config *cfg)
+{
+    lb_gen *g;
+    int e;
+
+    cfg->scope = LB_HOST;
+    if ((e = lb_create(cfg, &g)) != 0) {
+        err("%s: %s\n", what, strerror(e));
+        exit_status = 1;
+        shut_down();
+    }
+    return g;
+}
+
+static void gen_prepare(const char *what, lb_gen *g)
+{
+    int e;
+
+    if ((e = lb_prepare(g)) != 0) {
+        err("%s: %s\n", what, strerror(e));
+        exit_status = 1;
+        shut_down();
+    }
+}
+
+static void start_cpu_spinners(int *ncpus, int util_l, int util_h)
+{
+    struct lb_config cfg;
+    char desc[32];
+    lb_gen *g;
+    int i;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = LB_CPU;
+    cfg.target = util_l;
+    cfg.threads = *ncpus;
+    g = gen_create("cpu_spin", &cfg);
+    *ncpus = lb_workers(g);
+    if (replay != NULL)
+        say(1, "cpu_spin (%d): starting %d spinner(s) to replay %d"
+               " recorded CPU(s)\n", getpid(), *ncpus, replay->ncpus);
+    else
+        say(1, "cpu_spin (%d): starting %d spinner(s) for %d%%-%d%% usage\n",
+               getpid(), *ncpus, util_l, util_h);
+    gen_prepare("cpu_spin", g);
+    for (i = 0; i < *ncpus; i++) {
+        snprintf(desc, sizeof(desc), "CPU spinner %d", i);
+        fork_and_call(desc, gen_worker, i, 0, 0, g, NULL);
+    }
+}
+
+static void start_disk_stirrer(off_t util, char **paths, size_t paths_n)
+{
+    size_t i;
+
+    c_disk_share = (int)paths_n;
+    for (i = 0; i < paths_n; i++) {
+        struct lb_config cfg;
+        struct stat st;
+        int dir = stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode);
+        char *desc;
+        lb_gen *g;
+
+        if (dir && access(paths[i], W_OK) != 0) {
+            err("disk path %s is not writable\n", paths[i]);
+            shut_down();
+        }
+        desc = (char *)malloc(32 + strlen(paths[i]));
+        if (desc == NULL) {
+            perror("malloc");
+            shut_down();
+        }
+        snprintf(desc, 31 + strlen(paths[i]), "disk churn: %s", paths[i]);
+
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.kind = LB_DISK; /* paced by -D, with host scope */
+        cfg.size = util;
+        cfg.block_size = c_disk_churn_block_size;
+        cfg.path = paths[i];
+        g = gen_create(desc, &cfg);
+        if (dir) {
+            /* the scratch file in it is already unlinked; there's nothing
+             * here for shut_down() to remove */
+            free(paths[i]);
+            paths[i] = NULL;
+        }
+        gen_prepare(desc, g);
+        fork_and_call(desc, gen_worker, 0, 0, 0, g, NULL);
+        free(desc);
+    }
+}
+
+static void start_cache_filler(off_t sz)
+{
+    int fd = make_data_file("page cache file", sz);
+
+    /* the descriptor stays open here, so that a restarted filler finds the
+     * file, and whatever of it is still cached, where it left it */
+    fork_and_call("page cache filler", cache_fill, fd, sz, 0, NULL, NULL);
+}
+
+static void start_mem_whisker(size_t sz)
+{
+    struct lb_config cfg;
+    lb_gen *g;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = LB_MEM;
+    cfg.target = sz;
+    cfg.size = sz;
+    g = gen_create("mem_stir", &cfg);
+    gen_prepare("mem_stir", g);
+    fork_and_call("mem stirrer", gen_worker, 0, 0, 0, g, NULL);
+}
+
+static void start_sched_pairs(int npairs)
+{
+    char desc[48];
+    int i;
+    int warned = 0;
+
+    say(1, "sched_pingpong (%d): starting %d pair(s) via %s, %s placement\n",
+           getpid(), npairs, sched_method_names[c_sched_method],
+           cpu_distance_names[c_sched_distance]);
+    for (i = 0; i < npairs; i++) {
+        struct sched_pair *pair = (struct sched_pair *)calloc(1, sizeof(*pair));
+        int dir;
+
+        if (pair == NULL) {
+            perror("malloc");
+            shut_down();
+        }
+        for (dir = 0; dir < 2; dir++) {
+            int r = 0;
+            switch (c_sched_method) {
+                case SCHED_METHOD_PIPE:
+                    r = pipe(pair->fd[dir]);
+                    break;
+                case SCHED_METHOD_EVENTFD:
+#ifdef HAVE_SYS_EVENTFD_H
+                    r = pair->fd[dir][0] = eventfd(0, 0);
+#endif
+                    break;
+                case SCHED_METHOD_FUTEX:
+                    break;
+            }
+            if (r == -1) {
+                perror(sched_method_names[c_sched_method]);
+                shut_down();
+            }
+        }
+        pair->shared = (struct sched_shared *)mmap(NULL,
+                           sizeof(*pair->shared), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (pair->shared == MAP_FAILED) {
+            perror("mmap");
+            shut_down();
+        }
+        if (cpu_place(c_sched_distance, 2, pair->cpu) == -1) {
+            if (c_sched_distance != CPU_DIST_ANY && !warned++)
+                err("No CPUs at distance '%s' on this host; ping-pong pairs"
+                    " will run unpinned\n",
+                    cpu_distance_names[c_sched_distance]);
+            pair->cpu[0] = pair->cpu[1] = -1;
+        }
+
+        /* the channels are closed below, so a pair can't be restarted */
+        snprintf(desc, sizeof(desc), "sched ping-pong responder %d", i);
+        fork_and_call(desc, sched_pingpong, 1, i, npairs, pair,
+                      NULL)->restartable = 0;
+        snprintf(desc, sizeof(desc), "sched ping-pong initiator %d", i);
+        fork_and_call(desc, sched_pingpong, 0, i, npairs, pair,
+                      NULL)->restartable = 0;
+        for (dir = 0; dir < 2; dir++) {
+            if (c_sched_method == SCHED_METHOD_PIPE) {
+                close(pair->fd[dir][0]);
+                close(pair->fd[dir][1]);
+            } else if (c_sched_method == SCHED_METHOD_EVENTFD) {
+                close(pair->fd[dir][0]);
+            }
+        }
+        munmap(pair->shared, sizeof(*pair->shared));
+        free(pair);
+    }
+}
+
+static void start_contenders(int n)
+{
+    struct contend_shared *sh;
+    const size_t per_line = CACHE_LINE / sizeof(uint64_t);
+    size_t sz = sizeof(*sh) + sizeof(sh->stats[0]) * n +
+                (n + per_line - 1) / per_line * CACHE_LINE;
+    pthread_mutexattr_t ma;
+    pthread_rwlockattr_t ra;
+    char desc[32];
+    int *cpus;
+    int i;
+
+    cpus = (int *)malloc(sizeof(*cpus) * n);
+    if (cpus == NULL) {
+        perror("malloc");
+        shut_down();
+    }
+    sh = (struct contend_shared *)mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        perror("mmap");
+        shut_down();
+    }
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&sh->mutex, &ma);
+    sh->slots = (uint64_t *)&sh->stats[n];
+    pthread_rwlockattr_init(&ra);
+    pthread_rwlockattr_setpshared(&ra, PTHREAD_PROCESS_SHARED);
+    pthread_rwlock_init(&sh->rwlock, &ra);
+
+    if (cpu_place(c_contend_distance, n, cpus) == -1) {
+        if (c_contend_distance != CPU_DIST_ANY)
+            err("No CPUs at distance '%s' on this host; contenders will run"
+                " unpinned\n", cpu_distance_names[c_contend_distance]);
+        for (i = 0; i < n; i++)
+            cpus[i] = -1;
+    }
+    say(1, "contend (%d): starting %d contender(s) on %s, %s placement\n",
+           getpid(), n, contend_op_names[c_contend_op],
+           cpu_distance_names[c_contend_distance]);
+    /* the shared state stays mapped here for any restarted contenders */
+    for (i = 0; i < n; i++) {
+        snprintf(desc, sizeof(desc), "contender %d", i);
+        fork_and_call(desc, contend, i, n, cpus[i], sh, NULL);
+    }
+    free(cpus);
+}
+
+static void start_requests(int nworkers)
+{
+    struct req_shared *sh;
+    size_t sz;
+    pthread_mutexattr_t ma;
+    pthread_condattr_t ca;
+    char desc[32];
+    int i;
+
+    if (nworkers <= 0)
+        nworkers = get_cpu_count();
+    sz = sizeof(*sh) + sizeof(sh->stats[0]) * nworkers;
+    sh = (struct req_shared *)mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        perror("mmap");
+        shut_down();
+    }
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&sh->lock, &ma);
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&sh->nonempty, &ca);
+    sh->disk_fd = -1;
+
+    if (cpu_spin_rate == 0)
+        cpu_spin_prepare();
+
+    if (c_req_disk > 0) {
+        /* a file for requests to read from, shared by all workers */
+        sh->disk_size = c_req_disk * 1024;
+        if (sh->disk_size < 16 * 1024 * 1024)
+            sh->disk_size = 16 * 1024 * 1024;
+        if (sh->disk_size > 256 * 1024 * 1024)
+            sh->disk_size = 256 * 1024 * 1024;
+        sh->disk_size -= sh->disk_size % c_req_disk;
+        if (sh->disk_size < c_req_disk)
+            sh->disk_size = c_req_disk;
+        sh->disk_fd = make_data_file("request data file", sh->disk_size);
+    }
+
+    say(1, "requests (%d): starting %d worker(s) for %ld requests/sec,"
+           " %s arrivals, %ld usec CPU (%s) each\n", getpid(), nworkers,
+           c_req_rate, req_arrival_names[c_req_arrival], c_req_cpu,
+           sample_dist_names[c_req_cpu_dist]);
+    /* the shared queue stays mapped here for any restarted workers */
+    for (i = 0; i < nworkers; i++) {
+        snprintf(desc, sizeof(desc), "request worker %d", i);
+        fork_and_call(desc, req_serve, i, nworkers, 0, sh, NULL);
+    }
+    fork_and_call("request dispatcher", req_dispatch, nworkers, 0, 0, sh,
+                  NULL);
+}
+
+static void start_churn(int nthreads)
+{
+    char desc[32];
+
+    if (nthreads <= 0)
+        nthreads = get_cpu_count();
+    say(1, "churn (%d): starting %d thread(s) for %ld allocs/sec,"
+           " %ld mmap cycles/sec, %ld page faults/sec\n", getpid(), nthreads,
+           c_alloc_rate, c_mmap_rate, c_fault_rate);
+    snprintf(desc, sizeof(desc), "allocation churner");
+    fork_and_call(desc, churn, nthreads, 0, 0, NULL, NULL);
+}
+
+/* A socket bound to an ephemeral loopback port; returns the port */
+static int net_bind(int type, int *fd)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((*fd = socket(AF_INET, type | SOCK_NONBLOCK, 0)) == -1 ||
+        bind(*fd, (struct sockaddr *)&sa, sizeof(sa)) == -1 ||
+        (type == SOCK_STREAM && listen(*fd, 4096) == -1) ||
+        getsockname(*fd, (struct sockaddr *)&sa, &len) == -1) {
+        err("Couldn't set up loopback socket: %s\n", strerror(errno));
+        shut_down();
+    }
+    return ntohs(sa.sin_port);
+}
+
+/* Move lookbusy into a network namespace of its own, with just a loopback
+ * interface, so that its traffic is kept apart from the host's. */
+static void net_private_namespace()
+{
+    struct ifreq ifr;
+    int fd;
+
+    if (unshare(CLONE_NEWNET) == -1) {
+        err("Couldn't create a network namespace: %s\n", strerror(errno));
+        shut_down();
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strcpy(ifr.ifr_name, "lo");
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+        ioctl(fd, SIOCGIFFLAGS, &ifr) == -1 ||
+        (ifr.ifr_flags |= IFF_UP, ioctl(fd, SIOCSIFFLAGS, &ifr)) == -1) {
+        err("Couldn't bring up loopback in the new namespace: %s\n",
+            strerror(errno));
+        shut_down();
+    }
+    close(fd);
+}
+
+static void start_net(int nflows)
+{
+    char desc[32];
+    int i;
+
+    if (c_net_netns)
+        net_private_namespace();
+    say(1, "net (%d): starting %d %s flow(s), %zu-byte messages\n", getpid(),
+           nflows, net_proto_names[c_net_proto], net_msg_size());
+    for (i = 0; i < nflows; i++) {
+        int lfd, ufd = -1, port, uport = 0;
+
+        /* sockets are made here, so that a restarted server or client
+         * finds its peer where it was */
+        port = net_bind(SOCK_STREAM, &lfd);
+        if (c_net_proto == NET_PROTO_UDP)
+            uport = net_bind(SOCK_DGRAM, &ufd);
+        snprintf(desc, sizeof(desc), "net server %d", i);
+        fork_and_call(desc, net_server, i, lfd, ufd, NULL, NULL);
+        snprintf(desc, sizeof(desc), "net flow %d", i);
+        fork_and_call(desc, net_client, i, port, uport, NULL, NULL);
+    }
+}
+
+static void start_probe(uint64_t load_start)
+{
+    say(1, "probe (%d): starting probe every %ld usec%s%s\n", getpid(),
+           c_probe_interval, c_probe_fifo > 0 ? ", SCHED_FIFO" : "",
+           c_probe_cpu >= 0 ? ", pinned" : "");
+    fork_and_call("probe", probe, (long long)load_start, 0, 0, NULL, NULL);
 }
 
 static void usage()
 {
     static const char *msg =
 "lookbusy [ -h ] [ options ]\n"
+"lookbusy record [ -h ] [ options ] [ FILE ]\n"
 "General options:\n"
 "  -h, --help           Commandline help (you're reading it)\n"
 "  -v, --verbose        Verbose output (may be repeated)\n"
@@ -882,10 +3504,30 @@ static void usage()
 "  -P, --cpu-curve-period=TIME\n"
 "                       Duration of utilization curve period, in seconds (append\n"
 "		       'm', 'h', 'd' for other units)\n"
+"      --cpu-kernel=NAME\n"
+"                       Spin loop to burn CPU with ('squander' or 'fpu')\n"
+"      --cpu-cache=PATH Calibration cache file (default\n"
+"                         ~/.cache/lookbusy-calibration)\n"
+"      --no-cpu-cache   Always measure CPU speed at startup; don't cache it\n"
+"      --cpu-sys=PCT    Share of CPU load to generate in system mode, in percent\n"
+"                         (default 0)\n"
+"      --cpu-phase=MODE How spinners' busy phases line up ('free', 'sync' or\n"
+"                         'stagger'; default free)\n"
+"      --coord=NAME     Share a host-wide CPU target with other instances\n"
+"                         given the same NAME\n"
+"      --coord-weight=NUM\n"
+"                       This instance's share of the target, relative to\n"
+"                         the others' (default 1)\n"
 "Memory usage options:\n"
 "  -m, --mem-util=SIZE   Amount of memory to use (in bytes, followed by KB, MB,\n"
 "                         or GB for other units; see lookbusy(1))\n"
 "  -M, --mem-sleep=TIME Time to sleep between iterations, in usec (default 1000)\n"
+"      --mem-mode=MODE  How memory use varies over time ('fixed', 'ramp',\n"
+"                         'cosine' or 'sawtooth'; default fixed)\n"
+"      --mem-min=SIZE   Least memory to use in a varying mode (default 0)\n"
+"      --mem-period=TIME\n"
+"                       Period of the memory mode, in seconds (append 'm',\n"
+"                         'h', 'd' for other units; default 10m)\n"
 "Disk usage options:\n"
 "  -d, --disk-util=SIZE Size of files to use for disk churn (in bytes,\n"
 "                         followed by KB, MB, GB or TB for other units)\n"
@@ -896,16 +3538,193 @@ static void usage()
 "                       Time to sleep between iterations, in msec (default 100)\n"
 "  -f, --disk-path=PATH Path to a file/directory to use as a buffer (default\n"
 "                         /tmp); specify multiple times for additional paths\n"
+"      --disk-compress=RATIO\n"
+"                       Make written data compressible by RATIO (default:\n"
+"                         a fixed, trivially compressible pattern)\n"
+"      --disk-dedupe=RATIO\n"
+"                       Make written blocks deduplicable by RATIO (default 1)\n"
+"      --cache-util=SIZE\n"
+"                       Amount of file data to keep in the page cache, in a\n"
+"                         file under the first disk path (default 0)\n"
+"Scheduler options:\n"
+"      --sched-pairs=NUM\n"
+"                       Number of process pairs to ping-pong wakeups between\n"
+"                         (default 0, disabled)\n"
+"      --sched-rate=NUM Target handoffs (wakeups) per second over all pairs\n"
+"                         (default 0, as fast as possible)\n"
+"      --sched-method=METHOD\n"
+"                       Wakeup mechanism ('pipe', 'eventfd' or 'futex')\n"
+"      --sched-distance=DIST\n"
+"                       Placement of each pair ('any', 'same', 'smt', 'core'\n"
+"                         or 'socket')\n"
+"Contention options:\n"
+"      --contend=NUM    Number of processes contending for shared state\n"
+"                         (default 0, disabled)\n"
+"      --contend-op=OP  What to contend for ('atomic', 'mutex', 'rwlock' or\n"
+"                         'falseshare')\n"
+"      --contend-distance=DIST\n"
+"                       Placement of contenders ('any', 'same', 'smt', 'core'\n"
+"                         or 'socket')\n"
+"      --contend-ratio=PCT\n"
+"                       Share of operations on shared rather than private\n"
+"                         state, in percent (default 100)\n"
+"Request options:\n"
+"      --req-rate=NUM   Mean requests per second to arrive (default 0,\n"
+"                         disabled)\n"
+"      --req-workers=NUM\n"
+"                       Number of processes serving requests (default:\n"
+"                         autodetected CPU count)\n"
+"      --req-arrival=PROCESS\n"
+"                       Arrival process ('poisson' or 'bursty')\n"
+"      --req-burst=NUM  Rate multiplier during bursts (default 4)\n"
+"      --req-cpu=TIME   Mean CPU time per request, in usec (default 1000)\n"
+"      --req-cpu-dist=DIST\n"
+"                       Distribution of CPU time per request ('fixed',\n"
+"                         'exponential' or 'lognormal'; default exponential)\n"
+"      --req-mem=SIZE   Memory touched per request (default 0)\n"
+"      --req-disk=SIZE  Data read from disk per request (default 0)\n"
+"Network options:\n"
+"      --net-flows=NUM  Number of loopback flows, each a sender and an echo\n"
+"                         server (default 0, or 1 if a rate is given)\n"
+"      --net-proto=PROTO\n"
+"                       Protocol for messages ('tcp' or 'udp'; default tcp)\n"
+"      --net-bandwidth=SIZE\n"
+"                       Bytes per second to send, over all flows (default 0,\n"
+"                         as fast as possible)\n"
+"      --net-msg-rate=NUM\n"
+"                       Messages per second to send, over all flows, if no\n"
+"                         bandwidth is given (default 0)\n"
+"      --net-conn-rate=NUM\n"
+"                       TCP connections per second to open, use and close\n"
+"                         (default 0)\n"
+"      --net-msg-size=SIZE\n"
+"                       Size of each message (default 16KB for TCP, 1400\n"
+"                         bytes for UDP)\n"
+"      --net-zerocopy   Send with MSG_ZEROCOPY\n"
+"      --net-netns      Run in a private network namespace\n"
+"Allocation churn options:\n"
+"      --alloc-rate=NUM malloc/free pairs per second (default 0)\n"
+"      --alloc-size=SIZE\n"
+"                       Mean allocation size (default 256)\n"
+"      --alloc-size-dist=DIST\n"
+"                       Distribution of allocation sizes ('fixed',\n"
+"                         'exponential' or 'lognormal'; default exponential)\n"
+"      --mmap-rate=NUM  mmap/munmap cycles per second (default 0)\n"
+"      --mmap-size=SIZE Size of each mapping (default 1MB)\n"
+"      --fault-rate=NUM Additional page faults per second (default 0)\n"
+"      --churn-threads=NUM\n"
+"                       Threads to share the churn between (default:\n"
+"                         autodetected CPU count)\n"
+"Probe options:\n"
+"      --probe          Measure wakeup latency, timer overshoot and memory\n"
+"                         latency alongside the load, and report the impact\n"
+"      --probe-interval=TIME\n"
+"                       Probe cycle, in usec (default 1000)\n"
+"      --probe-cpu=NUM  CPU to pin the probe to (default: unpinned)\n"
+"      --probe-fifo=PRIO\n"
+"                       Run the probe SCHED_FIFO at this priority (default 0,\n"
+"                         normal scheduling)\n"
+"      --probe-mem=SIZE Buffer for the memory latency probe (default 8MB;\n"
+"                         0 disables)\n"
+"      --probe-baseline=TIME\n"
+"                       Time to probe before starting the load, in seconds\n"
+"                         (append 'm', 'h', 'd' for other units; default 5)\n"
+"Supervision options:\n"
+"      --restart=POLICY When to restart a worker which exits ('never',\n"
+"                         'on-failure' or 'always'; default never)\n"
+"      --restart-limit=NUM\n"
+"                       Times to restart any one worker before giving up\n"
+"                         (default 5)\n"
+"      --shutdown-timeout=TIME\n"
+"                       Time to let workers exit before killing them, in\n"
+"                         seconds (append 'm', 'h', 'd' for other units;\n"
+"                         default 5)\n"
+"Reporting options:\n"
+"      --stats-interval=TIME\n"
+"                       Interval between statistics reports, in seconds\n"
+"                         (append 'm', 'h', 'd' for other units; default 10)\n"
+"      --perf           Report hardware performance counters (cycles, IPC,\n"
+"                         cache, TLB and branch misses) for each worker\n"
+"Replay options:\n"
+"      --replay=FILE    Follow the CPU, memory and disk usage recorded in FILE\n"
+"                         by `lookbusy record' (see lookbusy(1))\n"
 "";
     printf("usage: %s", msg);
     exit(0);
 }
 
+/* options having no short form */
+enum {
+    OPT_CPU_KERNEL = 256,
+    OPT_CPU_CACHE,
+    OPT_NO_CPU_CACHE,
+    OPT_CPU_SYS,
+    OPT_CPU_PHASE,
+    OPT_COORD,
+    OPT_COORD_WEIGHT,
+    OPT_MEM_MODE,
+    OPT_MEM_MIN,
+    OPT_MEM_PERIOD,
+    OPT_CACHE_UTIL,
+    OPT_DISK_COMPRESS,
+    OPT_DISK_DEDUPE,
+    OPT_SCHED_PAIRS,
+    OPT_SCHED_RATE,
+    OPT_SCHED_METHOD,
+    OPT_SCHED_DISTANCE,
+    OPT_CONTEND,
+    OPT_CONTEND_OP,
+    OPT_CONTEND_DISTANCE,
+    OPT_CONTEND_RATIO,
+    OPT_REQ_RATE,
+    OPT_REQ_WORKERS,
+    OPT_REQ_ARRIVAL,
+    OPT_REQ_BURST,
+    OPT_REQ_CPU,
+    OPT_REQ_CPU_DIST,
+    OPT_REQ_MEM,
+    OPT_REQ_DISK,
+    OPT_NET_FLOWS,
+    OPT_NET_PROTO,
+    OPT_NET_BANDWIDTH,
+    OPT_NET_MSG_RATE,
+    OPT_NET_CONN_RATE,
+    OPT_NET_MSG_SIZE,
+    OPT_NET_ZEROCOPY,
+    OPT_NET_NETNS,
+    OPT_CHURN_THREADS,
+    OPT_ALLOC_RATE,
+    OPT_ALLOC_SIZE,
+    OPT_ALLOC_SIZE_DIST,
+    OPT_MMAP_RATE,
+    OPT_MMAP_SIZE,
+    OPT_FAULT_RATE,
+    OPT_PROBE,
+    OPT_PROBE_INTERVAL,
+    OPT_PROBE_CPU,
+    OPT_PROBE_FIFO,
+    OPT_PROBE_MEM,
+    OPT_PROBE_BASELINE,
+    OPT_STATS_INTERVAL,
+    OPT_PERF,
+    OPT_REPLAY,
+    OPT_RESTART,
+    OPT_RESTART_LIMIT,
+    OPT_SHUTDOWN_TIMEOUT
+};
+
 int main(int argc, char **argv)
 {
     int c;
     size_t disk_paths_cap = 0;
 
+    /* liblookbusy is quiet unless told otherwise; lookbusy isn't */
+    verbosity = 1;
+    sample_hook = perf_sample;
+
+    if (argc > 1 && strcmp(argv[1], "record") == 0)
+        return record_main(argc - 1, argv + 1);
+
     static const struct option long_options[] = {
         { "help", 0, NULL, 'h' },
         { "verbose", 0, NULL, 'v' },
@@ -918,6 +3737,19 @@ int main(int argc, char **argv)
         { "cpu-curve-peak", 1, NULL, 'p' },
         { "cpu-curve-period", 1, NULL, 'P' },
         { "utc", 0, NULL, 'u' },
+        { "cpu-kernel", 1, NULL, OPT_CPU_KERNEL },
+        { "cpu-cache", 1, NULL, OPT_CPU_CACHE },
+        { "no-cpu-cache", 0, NULL, OPT_NO_CPU_CACHE },
+        { "cpu-sys", 1, NULL, OPT_CPU_SYS },
+        { "cpu-phase", 1, NULL, OPT_CPU_PHASE },
+        { "coord", 1, NULL, OPT_COORD },
+        { "coord-weight", 1, NULL, OPT_COORD_WEIGHT },
+        { "mem-mode", 1, NULL, OPT_MEM_MODE },
+        { "mem-min", 1, NULL, OPT_MEM_MIN },
+        { "mem-period", 1, NULL, OPT_MEM_PERIOD },
+        { "cache-util", 1, NULL, OPT_CACHE_UTIL },
+        { "disk-compress", 1, NULL, OPT_DISK_COMPRESS },
+        { "disk-dedupe", 1, NULL, OPT_DISK_DEDUPE },
 
         { "disk-util", 1, NULL, 'd' },
         { "disk-sleep", 1, NULL, 'D' },
@@ -926,6 +3758,58 @@ int main(int argc, char **argv)
 
         { "mem-util", 1, NULL, 'm' },
         { "mem-sleep", 1, NULL, 'M' },
+
+        { "sched-pairs", 1, NULL, OPT_SCHED_PAIRS },
+        { "sched-rate", 1, NULL, OPT_SCHED_RATE },
+        { "sched-method", 1, NULL, OPT_SCHED_METHOD },
+        { "sched-distance", 1, NULL, OPT_SCHED_DISTANCE },
+
+        { "contend", 1, NULL, OPT_CONTEND },
+        { "contend-op", 1, NULL, OPT_CONTEND_OP },
+        { "contend-distance", 1, NULL, OPT_CONTEND_DISTANCE },
+        { "contend-ratio", 1, NULL, OPT_CONTEND_RATIO },
+
+        { "req-rate", 1, NULL, OPT_REQ_RATE },
+        { "req-workers", 1, NULL, OPT_REQ_WORKERS },
+        { "req-arrival", 1, NULL, OPT_REQ_ARRIVAL },
+        { "req-burst", 1, NULL, OPT_REQ_BURST },
+        { "req-cpu", 1, NULL, OPT_REQ_CPU },
+        { "req-cpu-dist", 1, NULL, OPT_REQ_CPU_DIST },
+        { "req-mem", 1, NULL, OPT_REQ_MEM },
+        { "req-disk", 1, NULL, OPT_REQ_DISK },
+
+        { "net-flows", 1, NULL, OPT_NET_FLOWS },
+        { "net-proto", 1, NULL, OPT_NET_PROTO },
+        { "net-bandwidth", 1, NULL, OPT_NET_BANDWIDTH },
+        { "net-msg-rate", 1, NULL, OPT_NET_MSG_RATE },
+        { "net-conn-rate", 1, NULL, OPT_NET_CONN_RATE },
+        { "net-msg-size", 1, NULL, OPT_NET_MSG_SIZE },
+        { "net-zerocopy", 0, NULL, OPT_NET_ZEROCOPY },
+        { "net-netns", 0, NULL, OPT_NET_NETNS },
+
+        { "churn-threads", 1, NULL, OPT_CHURN_THREADS },
+        { "alloc-rate", 1, NULL, OPT_ALLOC_RATE },
+        { "alloc-size", 1, NULL, OPT_ALLOC_SIZE },
+        { "alloc-size-dist", 1, NULL, OPT_ALLOC_SIZE_DIST },
+        { "mmap-rate", 1, NULL, OPT_MMAP_RATE },
+        { "mmap-size", 1, NULL, OPT_MMAP_SIZE },
+        { "fault-rate", 1, NULL, OPT_FAULT_RATE },
+
+        { "probe", 0, NULL, OPT_PROBE },
+        { "probe-interval", 1, NULL, OPT_PROBE_INTERVAL },
+        { "probe-cpu", 1, NULL, OPT_PROBE_CPU },
+        { "probe-fifo", 1, NULL, OPT_PROBE_FIFO },
+        { "probe-mem", 1, NULL, OPT_PROBE_MEM },
+        { "probe-baseline", 1, NULL, OPT_PROBE_BASELINE },
+
+        { "stats-interval", 1, NULL, OPT_STATS_INTERVAL },
+        { "perf", 0, NULL, OPT_PERF },
+
+        { "replay", 1, NULL, OPT_REPLAY },
+
+        { "restart", 1, NULL, OPT_RESTART },
+        { "restart-limit", 1, NULL, OPT_RESTART_LIMIT },
+        { "shutdown-timeout", 1, NULL, OPT_SHUTDOWN_TIMEOUT },
         { 0, 0, 0, 0 }
     };
 
@@ -984,6 +3868,50 @@ int main(int argc, char **argv)
             case 'M':
                 c_mem_stir_sleep = atol(optarg);
                 break;
+            case OPT_DISK_COMPRESS:
+                c_disk_compress = atof(optarg);
+                if (c_disk_compress < 1) {
+                    err("Compression ratio must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case OPT_DISK_DEDUPE:
+                c_disk_dedupe = atof(optarg);
+                if (c_disk_dedupe < 1) {
+                    err("Deduplication ratio must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case OPT_CACHE_UTIL:
+                if (parse_large_size(optarg, &c_cache_util) < 0) {
+                    err("Couldn't parse page cache size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_MEM_MODE:
+                if ((c = parse_choice(optarg, mem_mode_names)) < 0) {
+                    err("Unrecognized memory mode '%s'; choose one of 'fixed',"
+                        " 'ramp', 'cosine' or 'sawtooth'\n", optarg);
+                    return 1;
+                }
+                c_mem_mode = (enum mem_mode)c;
+                break;
+            case OPT_MEM_MIN:
+                if (parse_size(optarg, &c_mem_min) < 0) {
+                    err("Couldn't parse minimum memory size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_MEM_PERIOD:
+                if (parse_timespan(optarg, &c_mem_period) < 0 ||
+                    c_mem_period <= 0) {
+                    err("Couldn't parse memory period '%s'; format is"
+                        " INTEGER[SUFFIX], where SUFFIX\n"
+                        "is one of 's' (seconds), 'm' (minutes), 'h' (hours)"
+                        ", or 'd' (days); e.g. \"2h\"\n", optarg);
+                    return 1;
+                }
+                break;
             case 'n':
                 ncpus = atoi(optarg);
                 break;
@@ -1035,6 +3963,304 @@ int main(int argc, char **argv)
             case 'V':
                 printf("%s %s -- %s\n", PACKAGE, VERSION, copyright);
                 return 0;
+            case OPT_CPU_KERNEL:
+                for (c_cpu_kernel = 0; cpu_kernels[c_cpu_kernel].name != NULL;
+                     c_cpu_kernel++) {
+                    if (strcmp(optarg, cpu_kernels[c_cpu_kernel].name) == 0)
+                        break;
+                }
+                if (cpu_kernels[c_cpu_kernel].name == NULL) {
+                    err("Unrecognized CPU kernel '%s'; choose one of"
+                        " 'squander' or 'fpu'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CPU_CACHE:
+                c_cpu_cache_path = optarg;
+                c_cpu_cache = 1;
+                break;
+            case OPT_NO_CPU_CACHE:
+                c_cpu_cache = 0;
+                break;
+            case OPT_CPU_SYS:
+                c_cpu_sys_pct = atoi(optarg);
+                if (c_cpu_sys_pct < 0 || c_cpu_sys_pct > 100) {
+                    err("System CPU share must be between 0 and 100%%\n");
+                    return 1;
+                }
+                break;
+            case OPT_CPU_PHASE:
+                if ((c = parse_choice(optarg, cpu_phase_names)) < 0) {
+                    err("Unrecognized CPU phase alignment '%s'; choose one"
+                        " of 'free', 'sync' or 'stagger'\n", optarg);
+                    return 1;
+                }
+                c_cpu_phase = (enum cpu_phase)c;
+                break;
+            case OPT_COORD:
+                if (*optarg == '\0' || strchr(optarg, '/') != NULL) {
+                    err("Coordination name '%s' must be non-empty and"
+                        " contain no '/'\n", optarg);
+                    return 1;
+                }
+                c_coord_name = optarg;
+                break;
+            case OPT_COORD_WEIGHT:
+                c_coord_weight = atof(optarg);
+                if (c_coord_weight <= 0) {
+                    err("Coordination weight must be greater than 0\n");
+                    return 1;
+                }
+                break;
+            case OPT_SCHED_PAIRS:
+                c_sched_pairs = atoi(optarg);
+                break;
+            case OPT_SCHED_RATE:
+                c_sched_rate = atol(optarg);
+                break;
+            case OPT_SCHED_METHOD:
+                if ((c = parse_choice(optarg, sched_method_names)) < 0) {
+                    err("Unrecognized scheduler ping-pong method '%s'; choose"
+                        " one of 'pipe', 'eventfd' or 'futex'\n", optarg);
+                    return 1;
+                }
+                c_sched_method = (enum sched_method)c;
+                break;
+            case OPT_SCHED_DISTANCE:
+                if ((c = parse_choice(optarg, cpu_distance_names)) < 0) {
+                    err("Unrecognized CPU distance '%s'; choose one of 'any',"
+                        " 'same', 'smt', 'core' or 'socket'\n", optarg);
+                    return 1;
+                }
+                c_sched_distance = (enum cpu_distance)c;
+                break;
+            case OPT_CONTEND:
+                c_contend_workers = atoi(optarg);
+                break;
+            case OPT_CONTEND_OP:
+                if ((c = parse_choice(optarg, contend_op_names)) < 0) {
+                    err("Unrecognized contention operation '%s'; choose one"
+                        " of 'atomic', 'mutex', 'rwlock' or 'falseshare'\n",
+                        optarg);
+                    return 1;
+                }
+                c_contend_op = (enum contend_op)c;
+                break;
+            case OPT_CONTEND_DISTANCE:
+                if ((c = parse_choice(optarg, cpu_distance_names)) < 0) {
+                    err("Unrecognized CPU distance '%s'; choose one of 'any',"
+                        " 'same', 'smt', 'core' or 'socket'\n", optarg);
+                    return 1;
+                }
+                c_contend_distance = (enum cpu_distance)c;
+                break;
+            case OPT_CONTEND_RATIO:
+                c_contend_ratio = atoi(optarg);
+                if (c_contend_ratio < 0 || c_contend_ratio > 100) {
+                    err("Contention ratio must be between 0 and 100%%\n");
+                    return 1;
+                }
+                break;
+            case OPT_REQ_RATE:
+                c_req_rate = atol(optarg);
+                if (c_req_rate < 0) {
+                    err("Request rate must be 0 or greater\n");
+                    return 1;
+                }
+                break;
+            case OPT_REQ_WORKERS:
+                c_req_workers = atoi(optarg);
+                if (c_req_workers < 0) {
+                    err("Request worker count must be 0 or greater\n");
+                    return 1;
+                }
+                break;
+            case OPT_REQ_ARRIVAL:
+                if ((c = parse_choice(optarg, req_arrival_names)) < 0) {
+                    err("Unrecognized arrival process '%s'; choose one of"
+                        " 'poisson' or 'bursty'\n", optarg);
+                    return 1;
+                }
+                c_req_arrival = (enum req_arrival)c;
+                break;
+            case OPT_REQ_BURST:
+                c_req_burst = atoi(optarg);
+                if (c_req_burst < 1) {
+                    err("Burst factor must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case OPT_REQ_CPU:
+                c_req_cpu = atol(optarg);
+                if (c_req_cpu < 0) {
+                    err("Request CPU time must be 0 or greater\n");
+                    return 1;
+                }
+                break;
+            case OPT_REQ_CPU_DIST:
+                if ((c = parse_choice(optarg, sample_dist_names)) < 0) {
+                    err("Unrecognized distribution '%s'; choose one of"
+                        " 'fixed', 'exponential' or 'lognormal'\n", optarg);
+                    return 1;
+                }
+                c_req_cpu_dist = (enum sample_dist)c;
+                break;
+            case OPT_REQ_MEM:
+                if (parse_size(optarg, &c_req_mem) < 0) {
+                    err("Couldn't parse request memory size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_REQ_DISK:
+                if (parse_size(optarg, &c_req_disk) < 0) {
+                    err("Couldn't parse request read size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_NET_FLOWS:
+                c_net_flows = atoi(optarg);
+                break;
+            case OPT_NET_PROTO:
+                if ((c = parse_choice(optarg, net_proto_names)) < 0) {
+                    err("Unrecognized protocol '%s'; choose 'tcp' or"
+                        " 'udp'\n", optarg);
+                    return 1;
+                }
+                c_net_proto = (enum net_proto)c;
+                break;
+            case OPT_NET_BANDWIDTH:
+                if (parse_large_size(optarg, &c_net_bandwidth) < 0) {
+                    err("Couldn't parse network bandwidth '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_NET_MSG_RATE:
+                c_net_msg_rate = atol(optarg);
+                break;
+            case OPT_NET_CONN_RATE:
+                c_net_conn_rate = atol(optarg);
+                break;
+            case OPT_NET_MSG_SIZE:
+                if (parse_size(optarg, &c_net_msg_size) < 0) {
+                    err("Couldn't parse message size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_NET_ZEROCOPY:
+#ifdef NET_ZEROCOPY
+                c_net_zerocopy = 1;
+                break;
+#else
+                err("Zero-copy sends aren't supported on this system\n");
+                return 1;
+#endif
+            case OPT_NET_NETNS:
+                c_net_netns = 1;
+                break;
+            case OPT_CHURN_THREADS:
+                c_churn_threads = atoi(optarg);
+                break;
+            case OPT_ALLOC_RATE:
+                c_alloc_rate = atol(optarg);
+                break;
+            case OPT_ALLOC_SIZE:
+                if (parse_size(optarg, &c_alloc_size) < 0) {
+                    err("Couldn't parse allocation size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_ALLOC_SIZE_DIST:
+                if ((c = parse_choice(optarg, sample_dist_names)) < 0) {
+                    err("Unrecognized distribution '%s'; choose one of"
+                        " 'fixed', 'exponential' or 'lognormal'\n", optarg);
+                    return 1;
+                }
+                c_alloc_size_dist = (enum sample_dist)c;
+                break;
+            case OPT_MMAP_RATE:
+                c_mmap_rate = atol(optarg);
+                break;
+            case OPT_MMAP_SIZE:
+                if (parse_size(optarg, &c_mmap_size) < 0 || c_mmap_size == 0) {
+                    err("Couldn't parse mmap size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_FAULT_RATE:
+                c_fault_rate = atol(optarg);
+                break;
+            case OPT_PROBE:
+                c_probe = 1;
+                break;
+            case OPT_PROBE_INTERVAL:
+                c_probe_interval = atol(optarg);
+                if (c_probe_interval <= 0) {
+                    err("Probe interval must be a positive number of usec\n");
+                    return 1;
+                }
+                break;
+            case OPT_PROBE_CPU:
+                c_probe_cpu = atoi(optarg);
+                break;
+            case OPT_PROBE_FIFO:
+                c_probe_fifo = atoi(optarg);
+                if (c_probe_fifo < 0 ||
+                    c_probe_fifo > sched_get_priority_max(SCHED_FIFO)) {
+                    err("SCHED_FIFO priority must be between 1 and %d\n",
+                        sched_get_priority_max(SCHED_FIFO));
+                    return 1;
+                }
+                break;
+            case OPT_PROBE_MEM:
+                if (parse_size(optarg, &c_probe_mem) < 0) {
+                    err("Couldn't parse probe memory size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_PROBE_BASELINE:
+                if (parse_timespan(optarg, &c_probe_baseline) < 0) {
+                    err("Couldn't parse probe baseline '%s'; format is"
+                        " INTEGER[SUFFIX], where SUFFIX\n"
+                        "is one of 's' (seconds), 'm' (minutes), 'h' (hours)"
+                        ", or 'd' (days); e.g. \"2h\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_RESTART:
+                if ((c = parse_choice(optarg, restart_policy_names)) < 0) {
+                    err("Unrecognized restart policy '%s'; choose one of"
+                        " 'never', 'on-failure' or 'always'\n", optarg);
+                    return 1;
+                }
+                c_restart = (enum restart_policy)c;
+                break;
+            case OPT_RESTART_LIMIT:
+                c_restart_limit = atoi(optarg);
+                break;
+            case OPT_SHUTDOWN_TIMEOUT:
+                if (parse_timespan(optarg, &c_shutdown_timeout) < 0) {
+                    err("Couldn't parse shutdown timeout '%s'; format is"
+                        " INTEGER[SUFFIX], where SUFFIX\n"
+                        "is one of 's' (seconds), 'm' (minutes), 'h' (hours)"
+                        ", or 'd' (days); e.g. \"2h\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_STATS_INTERVAL:
+                if (parse_timespan(optarg, &c_stats_interval) < 0) {
+                    err("Couldn't parse statistics interval '%s'; format is"
+                        " INTEGER[SUFFIX], where SUFFIX\n"
+                        "is one of 's' (seconds), 'm' (minutes), 'h' (hours)"
+                        ", or 'd' (days); e.g. \"2h\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_PERF:
+                c_perf = 1;
+                break;
+            case OPT_REPLAY:
+                c_replay_path = optarg;
+                break;
         }
     }
 
@@ -1051,6 +4277,74 @@ int main(int argc, char **argv)
         return 1;
     }
 
+#ifndef HAVE_SYS_EVENTFD_H
+    if (c_sched_method == SCHED_METHOD_EVENTFD) {
+        err("eventfd ping-pong is not supported on this platform\n");
+        return 1;
+    }
+#endif
+#ifndef HAVE_LINUX_FUTEX_H
+    if (c_sched_method == SCHED_METHOD_FUTEX) {
+        err("futex ping-pong is not supported on this platform\n");
+        return 1;
+    }
+#endif
+
+    if (c_replay_path != NULL) {
+        uint64_t mem_max = 0, io = 0, avail = 0;
+        size_t i;
+
+        if ((replay = profile_load(c_replay_path)) == NULL)
+            return 1;
+        for (i = 0; i < replay->n; i++) {
+            if (replay->s[i].mem_kb > mem_max)
+                mem_max = replay->s[i].mem_kb;
+            io += replay->s[i].rd_iops + replay->s[i].wr_iops +
+                  replay->s[i].rd_kbps + replay->s[i].wr_kbps;
+        }
+        say(1, "lookbusy (%d): replaying %lu samples at %dms intervals"
+               " from %s\n", getpid(), (unsigned long)replay->n,
+               replay->interval_ms, c_replay_path);
+        /* memory and disk follow the profile too, unless it has none;
+         * -m and -d bound them */
+        host_mem_used_kb(&avail);
+        if (c_mem_util == 0 && mem_max > 0)
+            c_mem_util = (size_t)((mem_max < avail ? mem_max : avail) * 1024);
+        if (c_disk_util == 0 && io > 0)
+            c_disk_util = 64 * 1024 * 1024;
+        replay_start = mono_nsec();
+    }
+
+    /* a process-shared rwlock can't be made robust, so a contender killed
+     * holding it would hang any restarted in its place */
+    if (c_contend_workers > 0 && c_contend_op == CONTEND_RWLOCK &&
+        c_restart != RESTART_NEVER) {
+        err("--contend-op=rwlock can't be combined with --restart\n");
+        return 1;
+    }
+
+    if (c_coord_name != NULL && replay != NULL) {
+        err("--coord can't be combined with --replay\n");
+        return 1;
+    }
+
+    if (c_mem_mode != MEM_MODE_FIXED) {
+        if (replay != NULL) {
+            err("--mem-mode can't be combined with --replay\n");
+            return 1;
+        }
+        if (c_mem_util == 0) {
+            err("--mem-mode needs a maximum memory size (-m)\n");
+            return 1;
+        }
+        if (c_mem_min > c_mem_util) {
+            err("Minimum memory size exceeds the maximum (%lu > %lu)\n",
+                (unsigned long)c_mem_min, (unsigned long)c_mem_util);
+            return 1;
+        }
+        mem_shape_start = mono_nsec();
+    }
+
     if (c_disk_churn_paths == NULL && c_disk_util != 0) {
         c_disk_churn_paths = (char **)malloc(sizeof(*c_disk_churn_paths) * 1);
         *c_disk_churn_paths = strdup("/tmp");
@@ -1069,26 +4363,71 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    signal(SIGCHLD, sigchld_handler);
-    signal(SIGTERM, sigterm_handler);
-    signal(SIGINT, sigterm_handler);
+    if (c_net_flows == 0 &&
+        (c_net_bandwidth > 0 || c_net_msg_rate > 0 || c_net_conn_rate > 0))
+        c_net_flows = 1;
+    if (c_net_flows > 0 && c_net_msg_size > 0 &&
+        (c_net_msg_size < sizeof(struct net_hdr) ||
+         (c_net_proto == NET_PROTO_UDP && c_net_msg_size > NET_UDP_MAX))) {
+        err("Message size must be at least %lu bytes%s\n",
+            (unsigned long)sizeof(struct net_hdr),
+            c_net_proto == NET_PROTO_UDP ? ", and at most 65507 for UDP" : "");
+        return 1;
+    }
+
+    if (c_perf)
+        perf_probe();
 
+    supervise_init();
+
+    if (c_probe) {
+        uint64_t load_start = mono_nsec() +
+                              (uint64_t)c_probe_baseline * 1000000000;
+        start_probe(load_start); // forks
+        if (c_probe_baseline > 0) {
+            say(1, "lookbusy (%d): measuring a %ds baseline before starting"
+                   " the load\n", getpid(), c_probe_baseline);
+            supervise_until(load_start);
+        }
+    }
+    if (c_coord_name != NULL &&
+        coord_join(c_coord_name, c_coord_weight) != 0) {
+        exit_status = 1;
+        shut_down();
+    }
     if (ncpus != 0 && c_cpu_util_h != 0) {
-        cpu_pids = start_cpu_spinners(&ncpus, c_cpu_util_l, c_cpu_util_h); // forks
-        n_cpu_pids = ncpus;
+        start_cpu_spinners(&ncpus, c_cpu_util_l, c_cpu_util_h); // forks
+    }
+    if (coord != NULL) {
+        fork_and_call("coordination agent", coord_agent, c_cpu_util_l,
+                      c_cpu_util_h, 0, NULL, NULL);
     }
     if (c_disk_util != 0) {
-        disk_pids = start_disk_stirrer(c_disk_util,
-                                       c_disk_churn_paths,
-                                       c_disk_churn_paths_n); // forks
-        n_disk_pids = c_disk_churn_paths_n;
+        start_disk_stirrer(c_disk_util, c_disk_churn_paths,
+                           c_disk_churn_paths_n); // forks
     }
     if (c_mem_util != 0) {
-        mem_pid = start_mem_whisker(c_mem_util); // forks
+        start_mem_whisker(c_mem_util); // forks
     }
-    while (sleep(1) == 0)
-            say(2, "lookbusy (%d): waiting for spinners...\n", getpid());
-    shutdown();
+    if (c_cache_util != 0) {
+        start_cache_filler(c_cache_util); // forks
+    }
+    if (c_sched_pairs > 0) {
+        start_sched_pairs(c_sched_pairs); // forks
+    }
+    if (c_contend_workers > 0) {
+        start_contenders(c_contend_workers); // forks
+    }
+    if (c_req_rate > 0) {
+        start_requests(c_req_workers); // forks
+    }
+    if (c_net_flows > 0) {
+        start_net(c_net_flows); // forks
+    }
+    if (c_alloc_rate > 0 || c_mmap_rate > 0 || c_fault_rate > 0) {
+        start_churn(c_churn_threads); // forks
+    }
+    supervise(); // doesn't return
     return 0;
 }
 
@@ -0,0 +1,2680 @@
+/* $Id$
+ *
+ * liblookbusy -- the CPU, memory and disk load engines, behind the
+ *                generator interface in lookbusy.h; the lookbusy program
+ *                runs its own through it too (see lb-engine.h).
+ *
+ * Copyright (c) 2006, Devin Carraway <lookbusy@devin.com>.
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A generator's workers run the same engine whatever its scope.  LB_HOST
+ * workers are processes, forked by lb_start() or by lookbusy's supervisor,
+ * and a CPU spinner among them steers the host's busy time from /proc/stat
+ * as lookbusy always has.  LB_THREAD workers are threads of the caller and
+ * count only their own consumption: a spinner steers its own CPU time, and
+ * the memory stirrer its own buffer's residency.  That keeps them accurate
+ * however busy the rest of the process (or the host) is.  Either way,
+ * what the caller and the workers share is kept in memory mapped shared,
+ * so that retargeting reaches forked workers and their counters reach
+ * lb_stats().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <regex.h>
+#include <stdarg.h>
+#include <math.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <sched.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "lb-engine.h"
+
+#define LB_PERIOD 100000000ULL          /* nsec; memory adjustment interval */
+#define LB_DISK_TICK 10000000ULL        /* nsec */
+#define LB_WINDOW 1000000000ULL         /* nsec; for lb_stats' achieved */
+#define LB_DEFAULT_DISK_SIZE (64 * 1024 * 1024)
+#define LB_DEFAULT_BLOCK_SIZE (32 * 1024)
+
+const char *cpu_phase_names[] = {
+    "free", "sync", "stagger", NULL
+};
+
+const char *mem_mode_names[] = {
+    "fixed", "ramp", "cosine", "sawtooth", NULL
+};
+
+int verbosity = 0;
+int utc = 0;
+enum cpu_util_mode c_cpu_util_mode = UTIL_MODE_FIXED;
+int c_cpu_util_h = 50; /* percent */
+int c_cpu_curve_period = 86400; /* seconds */
+int c_cpu_curve_peak = 60 * 60 * 13; /* 1PM local time */
+int c_cpu_kernel = 0; /* index into cpu_kernels[] */
+char *c_cpu_cache_path; /* NULL: default location */
+int c_cpu_cache = 1;
+int c_cpu_sys_pct = 0; /* percent of busy time to spend in kernel */
+enum cpu_phase c_cpu_phase = CPU_PHASE_FREE;
+double c_coord_weight = 1;
+long c_mem_stir_sleep = 1000; /* 1000 usec / 1 ms */
+enum mem_mode c_mem_mode = MEM_MODE_FIXED;
+size_t c_mem_min = 0; /* bytes */
+int c_mem_period = 600; /* seconds */
+uint64_t mem_shape_start; /* mono_nsec() at which the shape begins */
+double c_disk_compress = 0; /* ratio; 0 for the plain pattern */
+double c_disk_dedupe = 0; /* ratio */
+int c_disk_share = 1;
+long c_disk_churn_sleep = 100; /* ms */
+size_t c_disk_churn_step_size = 4 * 1024; /* bytes */
+int c_stats_interval = 10; /* seconds; 0 disables */
+
+void (*sample_hook)(void);
+
+int say(int level, const char *fmt, ...)
+{
+    va_list ap;
+    int r;
+
+    if (level > verbosity) return 0;
+    va_start(ap, fmt);
+    r = vprintf(fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+int err(const char *fmt, ...)
+{
+    va_list ap;
+    int r;
+
+    va_start(ap, fmt);
+    r = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+static void sample()
+{
+    if (sample_hook != NULL)
+        sample_hook();
+}
+
+uint64_t mono_nsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+double timeval_usec(const struct timeval *tv)
+{
+    return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+
+void sleep_until_nsec(uint64_t t)
+{
+    struct timespec ts;
+
+    ts.tv_sec = t / 1000000000;
+    ts.tv_nsec = t % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/* xorshift64*: small, fast, and good enough for load generation */
+uint64_t rng_next(uint64_t *s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+/* uniform in (0, 1] */
+double rng_uniform(uint64_t *s)
+{
+    return ((rng_next(s) >> 11) + 1) * (1. / 9007199254740992.);
+}
+
+double rng_exponential(uint64_t *s, double mean)
+{
+    return -log(rng_uniform(s)) * mean;
+}
+
+double rng_sample(uint64_t *s, enum sample_dist dist, double mean)
+{
+    switch (dist) {
+        case DIST_EXPONENTIAL:
+            return rng_exponential(s, mean);
+        case DIST_LOGNORMAL: {
+            /* sigma 1: a long tail, with the mean where it should be */
+            double u1 = rng_uniform(s), u2 = rng_uniform(s);
+            double z = sqrt(-2 * log(u1)) * cos(2 * PI * u2);
+            return exp(log(mean) - .5 + z);
+        }
+        default:
+            return mean;
+    }
+}
+
+uint64_t rng_seed()
+{
+    uint64_t s = mono_nsec() ^ ((uint64_t)getpid() << 32);
+
+    return s ? s : 1;
+}
+uint64_t jiffies_to_usec(uint64_t jiffies)
+{
+    return jiffies * (1000 / sysconf(_SC_CLK_TCK)) * 1000;
+}
+
+int get_cpu_count()
+{
+    /* FIXME: linux-specific */
+    FILE *f;
+    char s[128];
+    int n = 0;
+    static const char *pattern =
+        "^physical *id +: *0*[1-9]";
+    regex_t ex;
+    int e;
+
+    if ((e = regcomp(&ex, pattern, REG_EXTENDED | REG_ICASE)) != 0) {
+        char errbuf[128];
+        regerror(e, &ex, errbuf, sizeof(errbuf)-1);
+        errbuf[sizeof(errbuf)-1] = '\0';
+
+        err("regcomp(%s): %s\n", pattern, errbuf);
+        return -1;
+    }
+
+    f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) {
+        /* no /proc here, or not Linux's */
+        regfree(&ex);
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? n : 1;
+    }
+    while (fgets(s, sizeof(s)-1, f) != NULL) {
+        s[sizeof(s)-1] = '\0';
+        if (!strncmp(s, "processor", strlen("processor"))) {
+            n++;
+        } else {
+            e = regexec(&ex, s, 0, NULL, 0);
+            if (e == 0) {
+                /* matched a phys-id other than zero, don't count it */
+                n--;
+            } else if (e != REG_NOMATCH) {
+                char errbuf[128];
+                regerror(e, &ex, errbuf, sizeof(errbuf)-1);
+                errbuf[sizeof(errbuf)-1] = '\0';
+                err("regexec: Couldn't match '%s' in '%s': %s\n",
+                    pattern, s, errbuf);
+                return -1;
+            }
+        }
+    }
+    fclose(f);
+    regfree(&ex);
+    if (n == 0) {
+        err("Couldn't get any CPU counts, assuming one CPU core\n");
+        err("If this is wrong, override with --ncpus\n");
+        n = 1;
+    }
+    return n;
+}
+
+/* CPUs we may run on, with enough topology to place cooperating workers
+ * near to or far from each other */
+struct cpu_topo {
+    int cpu;
+    int core;
+    int package;
+    int used; /* workers placed here so far */
+};
+static struct cpu_topo *cpu_topo;
+static int cpu_topo_n;
+
+static int read_sysfs_int(const char *fmt, int cpu, int dflt)
+{
+    char path[128];
+    FILE *f;
+    int v;
+
+    snprintf(path, sizeof(path), fmt, cpu);
+    if ((f = fopen(path, "r")) == NULL)
+        return dflt;
+    if (fscanf(f, "%d", &v) != 1)
+        v = dflt;
+    fclose(f);
+    return v;
+}
+
+int cpu_topo_load()
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (cpu_topo != NULL)
+        return cpu_topo_n;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    cpu_topo = (struct cpu_topo *)malloc(sizeof(*cpu_topo) * CPU_COUNT(&set));
+    if (cpu_topo == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        struct cpu_topo *t;
+
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        t = &cpu_topo[cpu_topo_n++];
+        t->cpu = cpu;
+        t->core = read_sysfs_int(
+            "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu, cpu);
+        t->package = read_sysfs_int(
+            "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+            cpu, 0);
+        t->used = 0;
+    }
+    return cpu_topo_n;
+}
+
+static int cpu_distance_ok(enum cpu_distance dist, const struct cpu_topo *a,
+                           const struct cpu_topo *b)
+{
+    switch (dist) {
+        case CPU_DIST_SAME:
+            return a == b;
+        case CPU_DIST_SMT:
+            return a != b && a->package == b->package && a->core == b->core;
+        case CPU_DIST_CORE:
+            return a->package == b->package && a->core != b->core;
+        case CPU_DIST_SOCKET:
+            return a->package != b->package;
+        default:
+            return 1;
+    }
+}
+
+/* Place n cooperating workers on CPUs such that each is the given distance
+ * from the one before it, preferring CPUs not already taken by this or an
+ * earlier placement.  Returns 0 with cpus[] filled in, or -1 if there is no
+ * such placement on this host, in which case the workers run unpinned.
+ */
+int cpu_place(enum cpu_distance dist, int n, int *cpus)
+{
+    int *chosen, *idx;
+    int i, j, k;
+
+    if (dist == CPU_DIST_ANY || cpu_topo_load() <= 0)
+        return -1;
+    chosen = (int *)calloc(cpu_topo_n, sizeof(*chosen));
+    idx = (int *)malloc(sizeof(*idx) * n);
+    if (chosen == NULL || idx == NULL) {
+        perror("malloc");
+        free(chosen);
+        free(idx);
+        return -1;
+    }
+    for (k = 0; k < n; k++) {
+        int best = -1;
+        for (i = 0; i < cpu_topo_n; i++) {
+            if (k > 0 &&
+                !cpu_distance_ok(dist, &cpu_topo[idx[k - 1]], &cpu_topo[i]))
+                continue;
+            if (k == 0 && n > 1) {
+                for (j = 0; j < cpu_topo_n; j++) {
+                    if (cpu_distance_ok(dist, &cpu_topo[i], &cpu_topo[j]))
+                        break;
+                }
+                if (j == cpu_topo_n)
+                    continue;
+            }
+            if (best == -1 || chosen[i] < chosen[best] ||
+                (chosen[i] == chosen[best] &&
+                 cpu_topo[i].used < cpu_topo[best].used))
+                best = i;
+        }
+        if (best == -1) {
+            free(chosen);
+            free(idx);
+            return -1;
+        }
+        idx[k] = best;
+        chosen[best]++;
+    }
+    for (k = 0; k < n; k++) {
+        cpus[k] = cpu_topo[idx[k]].cpu;
+        cpu_topo[idx[k]].used++;
+    }
+    free(chosen);
+    free(idx);
+    return 0;
+}
+
+void cpu_pin(const char *who, int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        err("%s (%d): couldn't pin to CPU %d: %s\n",
+            who, getpid(), cpu, strerror(errno));
+    else
+        say(2, "%s (%d): pinned to CPU %d\n", who, getpid(), cpu);
+}
+
+/* host-wide CPU-jiffies spent in user (including nice) and system mode */
+void get_cpu_times(uint64_t *user, uint64_t *sys)
+{
+    FILE *f;
+    char s[256];
+    uint64_t utime, ntime, stime;
+    static regex_t *ex = NULL;
+    static const char *pattern =
+        "^cpu[[:space:]]+([0-9]+)[[:space:]]+([0-9]+)[[:space:]]+([0-9]+)";
+    int r;
+
+    if (ex == NULL) {
+        ex = (regex_t *)malloc(sizeof(*ex));
+        if (ex == NULL) {
+            perror("malloc");
+            _exit(1);
+        }
+        if ((r = regcomp(ex,pattern, REG_EXTENDED)) != 0) {
+            char errbuf[128];
+            regerror(r, ex, errbuf, sizeof(errbuf)-1);
+            errbuf[sizeof(errbuf)-1] = '\0';
+
+            err("regcomp(%s): %s\n", pattern, errbuf);
+            _exit(1);
+        }
+    }
+
+    if ((f = fopen("/proc/stat", "r")) == NULL) {
+        perror("/proc/stat");
+        _exit(1);
+    }
+    if (fgets(s, sizeof(s)-1, f) == NULL) {
+        perror("fgets");
+        _exit(1);
+    }
+
+    regmatch_t matches[4];
+    if ((r = regexec(ex, s, 4, matches, 0)) != 0) {
+        char errbuf[128];
+        regerror(r, ex, errbuf, sizeof(errbuf)-1);
+        errbuf[sizeof(errbuf)-1] = '\0';
+
+        err("regexec: Couldn't match '%s' in '%s': %s\n", pattern, s, errbuf);
+        _exit(1);
+    }
+
+    utime = atol(s + matches[1].rm_so);
+    ntime = atol(s + matches[2].rm_so);
+    stime = atol(s + matches[3].rm_so);
+
+    say(3, "cpu_spin(%d): current utime=%"PRIu64
+           " ntime=%"PRIu64" stime=%"PRIu64" total=%"PRIu64"\n",
+            getpid(), utime, ntime, stime, utime + ntime + stime);
+    fclose(f);
+    *user = utime + ntime;
+    *sys = stime;
+}
+
+uint64_t get_cpu_busy_time()
+{
+    uint64_t user, sys;
+
+    get_cpu_times(&user, &sys);
+    return user + sys;
+}
+
+/* one "cpuN" line of /proc/stat, in jiffies; returns 0 if s isn't one */
+int parse_cpu_stat_line(const char *s, int *cpu, uint64_t *busy,
+                        uint64_t *total)
+{
+    unsigned long long v[8] = { 0 };
+    int n;
+
+    if (strncmp(s, "cpu", 3) != 0 || !isdigit((unsigned char)s[3]))
+        return 0;
+    n = sscanf(s + 3, "%d %llu %llu %llu %llu %llu %llu %llu %llu", cpu,
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    if (n < 5)
+        return 0;
+    /* user nice system idle iowait irq softirq steal */
+    *busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+    *total = *busy + v[3] + v[4];
+    return 1;
+}
+
+/* CPU-jiffies spent busy on one CPU */
+static uint64_t get_cpu_busy_time_on(int which)
+{
+    FILE *f;
+    char s[256];
+    uint64_t busy = 0, total;
+    int cpu;
+
+    if ((f = fopen("/proc/stat", "r")) == NULL) {
+        perror("/proc/stat");
+        _exit(1);
+    }
+    while (fgets(s, sizeof(s), f) != NULL) {
+        if (parse_cpu_stat_line(s, &cpu, &busy, &total) && cpu == which)
+            break;
+        busy = 0;
+    }
+    fclose(f);
+    return busy;
+}
+
+/* host memory in use, excluding reclaimable caches, in kB; also what's
+ * available, if avail isn't NULL */
+uint64_t host_mem_used_kb(uint64_t *avail_kb)
+{
+    FILE *f;
+    char s[128];
+    unsigned long long total = 0, avail = 0;
+
+    if ((f = fopen("/proc/meminfo", "r")) == NULL)
+        return 0;
+    while (fgets(s, sizeof(s), f) != NULL) {
+        sscanf(s, "MemTotal: %llu kB", &total);
+        sscanf(s, "MemAvailable: %llu kB", &avail);
+    }
+    fclose(f);
+    if (avail_kb != NULL)
+        *avail_kb = avail;
+    return total > avail ? total - avail : 0;
+}
+
+
+struct profile *replay;  /* loaded before any workers start */
+uint64_t replay_start;   /* mono_nsec() at which sample 0 applies */
+
+/* the sample in effect now; the profile repeats once it runs out */
+static size_t replay_index()
+{
+    uint64_t ms = (mono_nsec() - replay_start) / 1000000;
+
+    return (size_t)(ms / replay->interval_ms % replay->n);
+}
+
+/* Utilization for spinner `index` of `n`.  Recorded CPUs are folded onto
+ * the spinners round-robin, so that a profile from a bigger host keeps its
+ * total load (as far as 100% per spinner allows).
+ */
+static double replay_cpu_util(int index, int n)
+{
+    const unsigned char *cpu = replay->cpu + replay_index() * replay->ncpus;
+    int sum = 0, j;
+
+    for (j = index; j < replay->ncpus; j += n)
+        sum += cpu[j];
+    return sum > 100 ? 100 : sum;
+}
+
+/* a rate measured over the last LB_WINDOW */
+struct lb_window {
+    uint64_t t0, v0;                    /* t0 0: not begun */
+    double rate;                        /* per second */
+};
+
+/* what a generator's workers share with its caller */
+struct lb_shared {
+    int running;                        /* accessed atomically */
+    double target;                      /* accessed atomically */
+    uint64_t cpu_ns;                    /* accessed atomically */
+    uint64_t written, read;             /* accessed atomically */
+    uint64_t resident;                  /* accessed atomically */
+    pthread_mutex_t lock;               /* window */
+    struct lb_window window;
+};
+
+struct lb_gen {
+    struct lb_config cfg;
+    struct lb_shared *sh;
+    int nworkers;
+    int nstarted;                       /* by lb_start() */
+    pthread_t *tids;                    /* LB_THREAD */
+    pid_t *pids;                        /* LB_HOST */
+    uint64_t start;
+
+    /* LB_CPU, LB_HOST */
+    int hostcpus;
+
+    /* LB_MEM */
+    char *buf;
+    size_t reserved;
+
+    /* LB_DISK */
+    char *path;
+    int fd;
+    off_t fsize;
+};
+
+static uint64_t thread_cpu_nsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int running(lb_gen *g)
+{
+    return __atomic_load_n(&g->sh->running, __ATOMIC_RELAXED);
+}
+
+static double get_target(lb_gen *g)
+{
+    double t;
+
+    __atomic_load(&g->sh->target, &t, __ATOMIC_RELAXED);
+    return t;
+}
+
+static void gen_lock(lb_gen *g)
+{
+    /* a LB_HOST worker killed holding the lock leaves nothing half-done
+     * but the window */
+    if (pthread_mutex_lock(&g->sh->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&g->sh->lock);
+}
+
+/* fold the counter's current value v into the window, at time now */
+static void window_update(lb_gen *g, uint64_t now, uint64_t v)
+{
+    struct lb_window *w = &g->sh->window;
+
+    gen_lock(g);
+    if (w->t0 == 0) {
+        w->t0 = now;
+        w->v0 = v;
+    } else if (now - w->t0 >= LB_WINDOW) {
+        w->rate = (double)(v - w->v0) * 1e9 / (now - w->t0);
+        w->t0 = now;
+        w->v0 = v;
+    }
+    pthread_mutex_unlock(&g->sh->lock);
+}
+
+/* add the calling worker's CPU time since *last to the generator's */
+static void account_cpu(lb_gen *g, uint64_t *last)
+{
+    uint64_t c = thread_cpu_nsec();
+
+    __atomic_add_fetch(&g->sh->cpu_ns, c - *last, __ATOMIC_RELAXED);
+    *last = c;
+}
+
+static char cpu_spin_accumulator;
+static double cpu_spin_fp_accumulator;
+
+static char squander_time(uint64_t iteration)
+{
+    return (cpu_spin_accumulator += (char)iteration);
+}
+
+static void cpu_kernel_squander(uint64_t iterations)
+{
+    uint64_t counter;
+
+    for (counter = 0; counter < iterations; counter++) {
+        squander_time(counter);
+    }
+}
+
+/* a dependent floating-point multiply-add chain; exercises the FPU rather
+ * than the integer units, still without meaningful memory traffic */
+static void cpu_kernel_fpu(uint64_t iterations)
+{
+    uint64_t counter;
+    double acc = cpu_spin_fp_accumulator;
+
+    for (counter = 0; counter < iterations; counter++) {
+        acc = acc * 0.999999 + (double)(counter & 0xff);
+    }
+    cpu_spin_fp_accumulator = acc;
+}
+
+const struct cpu_kernel cpu_kernels[] = {
+    { "squander", cpu_kernel_squander },
+    { "fpu", cpu_kernel_fpu },
+    { NULL, NULL }
+};
+
+/* speed of the selected kernel in iterations/sec, established by the parent
+ * before any spinners are forked and inherited by all of them */
+double cpu_spin_rate;
+static char cpu_cache_key[256];
+
+static double cpu_spin_measure()
+{
+    struct timeval tv, tv2;
+    const uint64_t iterations = 10000000;
+
+    say(1, "cpu_spin (%d): measuring CPU\n", getpid());
+    gettimeofday(&tv, NULL);
+    cpu_kernels[c_cpu_kernel].fn(iterations);
+    gettimeofday(&tv2, NULL);
+    long long elapsed = (tv2.tv_sec - tv.tv_sec) * 1000000 +
+                    (tv2.tv_usec - tv.tv_usec);
+    if (elapsed <= 0)
+        elapsed = 1;
+    double countspeed = (double)iterations * 1000000. / elapsed;
+    say(3, "cpu_spin (%d): %"PRIu64" iterations in %lld usec (%.0f/sec)\n",
+           getpid(), iterations, elapsed, countspeed);
+    return countspeed;
+}
+
+static void cpu_spin_calibrate(double util, uint64_t *busycount, suseconds_t *sleeptime)
+{
+    /* busy_count_time = busycount/rate
+     * idle_time = period - busy_count_time
+     */
+    *busycount = (uint64_t)(cpu_spin_rate * CPU_SPIN_PERIOD / 1000000. *
+                            util / 100.);
+    *sleeptime = CPU_SPIN_PERIOD -
+                 (suseconds_t)(*busycount * 1000000. / cpu_spin_rate);
+    if (*sleeptime < 0)
+        *sleeptime = 0;
+
+    say(1, "cpu_spin (%d): est. %d%% util at %"PRIu64" cycles, %u usec sleep\n",
+            getpid(), (int)util, *busycount, (unsigned)*sleeptime);
+}
+
+/* Calibration results are kept in a small text file, one line per host
+ * configuration:
+ *
+ *   <cpu model>|<cpufreq governor>|<kernel release>|<spin kernel><TAB><rate>
+ *
+ * so that a restart on the same machine can begin at the right duty cycle
+ * immediately instead of spending time (and, with several spinners, each
+ * other's CPU) on a fresh benchmark.
+ */
+static void cpu_cache_clean(char *s)
+{
+    char *p;
+
+    for (p = s; *p; p++) {
+        if (*p == '|' || *p == '\t' || *p == '\n' || *p == '\r')
+            *p = ' ';
+    }
+    while (p > s && isspace((unsigned char)p[-1]))
+        *--p = '\0';
+}
+
+static void cpu_cache_make_key(char *key, size_t sz)
+{
+    static const char *model_tags[] = {
+        "model name", "cpu model", "Processor", "cpu", NULL
+    };
+    char model[128] = "unknown", governor[64] = "none", s[256];
+    struct utsname un;
+    FILE *f;
+    int i;
+
+    if ((f = fopen("/proc/cpuinfo", "r")) != NULL) {
+        int best = -1;
+        while (fgets(s, sizeof(s), f) != NULL) {
+            char *colon = strchr(s, ':');
+            if (colon == NULL)
+                continue;
+            for (i = 0; model_tags[i] != NULL; i++) {
+                size_t n = strlen(model_tags[i]);
+                if (strncmp(s, model_tags[i], n) != 0)
+                    continue;
+                while (s[n] == ' ' || s[n] == '\t')
+                    n++;
+                if (s + n == colon && (best == -1 || i < best)) {
+                    best = i;
+                    colon++;
+                    while (isspace((unsigned char)*colon))
+                        colon++;
+                    snprintf(model, sizeof(model), "%s", colon);
+                    break;
+                }
+            }
+        }
+        fclose(f);
+    }
+    if ((f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+                   "r")) != NULL) {
+        if (fgets(governor, sizeof(governor), f) == NULL)
+            strcpy(governor, "none");
+        fclose(f);
+    }
+    if (uname(&un) == -1)
+        strcpy(un.release, "unknown");
+
+    cpu_cache_clean(model);
+    cpu_cache_clean(governor);
+    cpu_cache_clean(un.release);
+    snprintf(key, sz, "%s|%s|%s|%s", model, governor, un.release,
+             cpu_kernels[c_cpu_kernel].name);
+}
+
+static const char *cpu_cache_path()
+{
+    static char *path;
+    const char *base, *home;
+
+    if (c_cpu_cache_path != NULL || path != NULL)
+        return c_cpu_cache_path != NULL ? c_cpu_cache_path : path;
+
+    base = getenv("XDG_CACHE_HOME");
+    home = getenv("HOME");
+    if (base != NULL && *base != '\0') {
+        path = (char *)malloc(strlen(base) + 32);
+        if (path == NULL)
+            return NULL;
+        sprintf(path, "%s/lookbusy-calibration", base);
+    } else if (home != NULL && *home != '\0') {
+        path = (char *)malloc(strlen(home) + 48);
+        if (path == NULL)
+            return NULL;
+        sprintf(path, "%s/.cache", home);
+        if (mkdir(path, 0700) == -1 && errno != EEXIST) {
+            free(path);
+            path = NULL;
+            return "/var/tmp/lookbusy-calibration";
+        }
+        strcat(path, "/lookbusy-calibration");
+    } else {
+        return "/var/tmp/lookbusy-calibration";
+    }
+    return path;
+}
+
+static int cpu_cache_lookup(const char *key, double *rate)
+{
+    const char *path = cpu_cache_path();
+    size_t keylen = strlen(key);
+    char s[512];
+    FILE *f;
+    int found = 0;
+
+    if (path == NULL || (f = fopen(path, "r")) == NULL)
+        return -1;
+    while (fgets(s, sizeof(s), f) != NULL) {
+        if (!strncmp(s, key, keylen) && s[keylen] == '\t') {
+            *rate = strtod(s + keylen + 1, NULL);
+            found = *rate > 0;
+        }
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+static int cpu_cache_store(const char *key, double rate)
+{
+    const char *path = cpu_cache_path();
+    size_t keylen = strlen(key);
+    char s[512], *tmp;
+    FILE *in, *out;
+
+    if (path == NULL)
+        return -1;
+    if ((tmp = (char *)malloc(strlen(path) + 32)) == NULL)
+        return -1;
+    sprintf(tmp, "%s.%d", path, getpid());
+    if ((out = fopen(tmp, "w")) == NULL) {
+        say(1, "cpu_spin (%d): not caching calibration in %s: %s\n",
+               getpid(), tmp, strerror(errno));
+        free(tmp);
+        return -1;
+    }
+    fprintf(out, "# lookbusy CPU calibration cache; key<TAB>iterations/sec\n");
+    if ((in = fopen(path, "r")) != NULL) {
+        while (fgets(s, sizeof(s), in) != NULL) {
+            if (s[0] == '#' || (!strncmp(s, key, keylen) && s[keylen] == '\t'))
+                continue;
+            fputs(s, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%.0f\n", key, rate);
+    if (fclose(out) != 0 || rename(tmp, path) == -1) {
+        say(1, "cpu_spin (%d): not caching calibration in %s: %s\n",
+               getpid(), path, strerror(errno));
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+/* Establish cpu_spin_rate once, in the parent: from the cache if there's an
+ * entry for this host, otherwise by measuring (with no other spinners yet
+ * running to skew the result) and caching what was found.
+ */
+void cpu_spin_prepare()
+{
+    cpu_cache_make_key(cpu_cache_key, sizeof(cpu_cache_key));
+    if (c_cpu_cache && cpu_cache_lookup(cpu_cache_key, &cpu_spin_rate) == 0) {
+        say(1, "cpu_spin (%d): using cached calibration, %.0f iterations/sec"
+               " (%s)\n", getpid(), cpu_spin_rate, cpu_cache_key);
+        return;
+    }
+    cpu_spin_rate = cpu_spin_measure();
+    if (c_cpu_cache)
+        cpu_cache_store(cpu_cache_key, cpu_spin_rate);
+}
+
+/* System-mode load: one unit is a trivial syscall, a small write to
+ * /dev/null and, every eighth unit, a fresh minor page fault.  Its cost is
+ * expressed in iterations of the user-mode kernel so that it can be carved
+ * out of the same busy budget.
+ */
+static int cpu_sys_fd = -1;
+static char *cpu_sys_page;
+static double cpu_sys_unit_iters;
+
+static void cpu_sys_work(uint64_t units)
+{
+    static char buf[512];
+    static unsigned n;
+    uint64_t i;
+
+    for (i = 0; i < units; i++) {
+        syscall(SYS_getppid);
+        if (write(cpu_sys_fd, buf, sizeof(buf)) == -1)
+            continue;
+        if ((++n & 7) == 0) {
+            madvise(cpu_sys_page, LB_PAGE_SIZE, MADV_DONTNEED);
+            cpu_sys_page[0] = (char)n;
+        }
+    }
+}
+
+static int cpu_sys_prepare()
+{
+    struct timeval tv, tv2;
+    const uint64_t units = 20000;
+
+    if ((cpu_sys_fd = open("/dev/null", O_WRONLY)) == -1) {
+        perror("/dev/null");
+        return errno;
+    }
+    cpu_sys_page = (char *)mmap(NULL, LB_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cpu_sys_page == MAP_FAILED) {
+        int e = errno;
+        perror("mmap");
+        close(cpu_sys_fd);
+        cpu_sys_fd = -1;
+        return e;
+    }
+    gettimeofday(&tv, NULL);
+    cpu_sys_work(units);
+    gettimeofday(&tv2, NULL);
+    long long elapsed = (tv2.tv_sec - tv.tv_sec) * 1000000 +
+                        (tv2.tv_usec - tv.tv_usec);
+    if (elapsed <= 0)
+        elapsed = 1;
+    cpu_sys_unit_iters = cpu_spin_rate * elapsed / 1e6 / units;
+    say(2, "cpu_spin (%d): system work at %.2f usec/unit (~%.0f iterations)\n",
+           getpid(), (double)elapsed / units, cpu_sys_unit_iters);
+    return 0;
+}
+
+/* Called by the first spinner once it has watched enough real spin phases
+ * to know how fast the kernel actually runs under steady-state conditions;
+ * corrects the cache if the startup figure was off.
+ */
+static void cpu_spin_refine(double observed)
+{
+    double drift = (observed - cpu_spin_rate) / cpu_spin_rate;
+
+    if (fabs(drift) < 0.05) {
+        say(2, "cpu_spin (%d): calibration confirmed (%.0f iterations/sec"
+               " observed)\n", getpid(), observed);
+        return;
+    }
+    say(1, "cpu_spin (%d): calibration off by %+.0f%%; %.0f iterations/sec"
+           " observed\n", getpid(), drift * 100, observed);
+    if (c_cpu_cache)
+        cpu_cache_store(cpu_cache_key, observed);
+}
+
+static double cpu_spin_compute_util(enum cpu_util_mode mode, double l,
+                                    double h, time_t curtime)
+{
+    static long time_offset = -1;
+
+    if (time_offset == -1) {
+        if (!utc) {
+#ifdef HAVE_TZSET
+            tzset();
+#endif
+            time_offset = -timezone;
+        } else {
+            time_offset = 0;
+        }
+        time_offset += c_cpu_curve_peak;
+    }
+
+    if (mode == UTIL_MODE_FIXED) return l;
+    if (mode == UTIL_MODE_CURVE) {
+        if (curtime == 0)
+            curtime = time(NULL);
+        long offset_in_interval = (curtime + time_offset) % c_cpu_curve_period;
+        double fraction = (double)offset_in_interval / (double)c_cpu_curve_period;
+        /* model the CPU usage as a cosine function over [0,2pi], shifted up
+         * by min+1 to place the floor on min, and scaled so as to have its
+         * entire range between min and max.  That is, the peak of the cosine
+         * curve is placed at X=0, and it oscillates over the selected CPU
+         * utilization range.
+         *
+         * This isn't a particularly realistic utilization curve and something
+         * better ought to be found.  Or just bite the bullet and make it
+         * data-driven.
+         */
+        double level = l + (h - l) * (cos(fraction * PI * 2) + 1)/2;
+        return level;
+    }
+    /* shouldn't get here */
+    return -1;
+}
+
+/* The spinners' shared schedule, for --cpu-phase: period k of spinner i
+ * begins at epoch + k * period + offset(i), on the host-wide monotonic
+ * clock.  It lives in shared memory set up by the parent, so restarted
+ * spinners fall back into step, and each spinner accounts there for how
+ * late its bursts actually start.
+ */
+struct phase_schedule {
+    uint64_t epoch;
+    uint64_t period;
+    int nspinners;
+    struct {
+        uint64_t late_sum __attribute__((aligned(CACHE_LINE)));
+        uint64_t late_max;
+        uint64_t bursts;
+    } stats[];
+};
+static struct phase_schedule *phase_sched;
+
+static uint64_t phase_offset(int index)
+{
+    if (c_cpu_phase == CPU_PHASE_STAGGER)
+        return phase_sched->period * index / phase_sched->nspinners;
+    return 0;
+}
+
+/* the period boundary this spinner last started a burst at */
+static uint64_t phase_last = 0;
+
+/* sleep until this spinner's next period starts, and account for any
+ * lateness in waking up for it.  A burst which ran past the end of its
+ * period starts the next one at once, late, rather than idling until the
+ * boundary after. */
+static void phase_wait(int index)
+{
+    const uint64_t base = phase_sched->epoch + phase_offset(index);
+    const uint64_t period = phase_sched->period;
+    uint64_t now = mono_nsec(), start, late;
+
+    if (now <= base) {
+        start = base;
+    } else {
+        start = base + (now - base) / period * period;
+        if (start <= phase_last)
+            start += period;
+    }
+    sleep_until_nsec(start);
+    phase_last = start;
+    late = mono_nsec() - start;
+    __atomic_fetch_add(&phase_sched->stats[index].late_sum, late,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phase_sched->stats[index].bursts, 1,
+                       __ATOMIC_RELAXED);
+    if (late > __atomic_load_n(&phase_sched->stats[index].late_max,
+                               __ATOMIC_RELAXED))
+        __atomic_store_n(&phase_sched->stats[index].late_max, late,
+                         __ATOMIC_RELAXED);
+}
+
+static void phase_report()
+{
+    uint64_t sum = 0, max = 0, bursts = 0;
+    int i;
+
+    for (i = 0; i < phase_sched->nspinners; i++) {
+        uint64_t m;
+        sum += __atomic_exchange_n(&phase_sched->stats[i].late_sum, 0,
+                                   __ATOMIC_RELAXED);
+        bursts += __atomic_exchange_n(&phase_sched->stats[i].bursts, 0,
+                                      __ATOMIC_RELAXED);
+        m = __atomic_exchange_n(&phase_sched->stats[i].late_max, 0,
+                                __ATOMIC_RELAXED);
+        if (m > max)
+            max = m;
+    }
+    if (bursts > 0)
+        say(1, "cpu_spin (%d): %s phases: %"PRIu64" bursts across %d"
+               " spinner(s) started on average %.0f usec late, at most"
+               " %.0f usec\n", getpid(), cpu_phase_names[c_cpu_phase],
+               bursts, phase_sched->nspinners, sum / 1e3 / bursts, max / 1e3);
+}
+
+/* set the schedule up, before any of the spinners start */
+static int phase_prepare(int nspinners)
+{
+    size_t sz = sizeof(*phase_sched) +
+                sizeof(phase_sched->stats[0]) * nspinners;
+
+    phase_sched = (struct phase_schedule *)mmap(NULL, sz,
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                      -1, 0);
+    if (phase_sched == MAP_FAILED) {
+        int e = errno;
+        perror("mmap");
+        phase_sched = NULL;
+        return e;
+    }
+    phase_sched->period = (uint64_t)CPU_SPIN_PERIOD * 1000;
+    phase_sched->nspinners = nspinners;
+    /* far enough ahead for every spinner to be ready for period 0 */
+    phase_sched->epoch = mono_nsec() + 4 * phase_sched->period;
+    say(1, "cpu_spin (%d): %s phases on a %"PRIu64" usec period\n",
+           getpid(), cpu_phase_names[c_cpu_phase],
+           phase_sched->period / 1000);
+    return 0;
+}
+
+/* Coordination between lookbusy instances on one host, for --coord: each
+ * instance holds a slot in a named POSIX shared memory segment, kept alive
+ * by a heartbeat from its agent process, and its spinners add the CPU time
+ * they use to the slot.  One agent at a time is the coordinator.  It takes
+ * the instances' own use away from the host's busy time to find the load
+ * from everything else, and divides what that leaves of its target between
+ * the instances by weight; each instance's spinners then steer their
+ * combined use to its allocation, instead of all of them chasing
+ * /proc/stat at once.  Heartbeats are on the monotonic clock, which is the
+ * same across containers on a host, and an agent that finds the
+ * coordinator's heartbeat stale takes over from it.
+ */
+#define COORD_MAGIC 0x6c62636f6f726431ULL /* "lbcoord1" */
+#define COORD_SLOTS 64
+#define COORD_TICK 100000000ULL /* nsec between heartbeats */
+#define COORD_STALE 1000000000ULL /* nsec without one before a slot is dead */
+#define COORD_RECALIBRATE 10 /* percent an allocation moves to re-estimate */
+
+struct coord_slot {
+    uint64_t id;                /* 0: free */
+    uint64_t heartbeat;
+    double weight;
+    int nspinners;
+    double alloc;               /* percent of the host, from the coordinator */
+    uint64_t cpu_usec __attribute__((aligned(CACHE_LINE)));
+};
+
+struct coord_shared {
+    uint64_t magic;
+    pthread_mutex_t lock;
+    int coordinator;            /* slot index; -1: none */
+    struct coord_slot slot[COORD_SLOTS];
+};
+
+struct coord_shared *coord;
+static char coord_path[256];
+static int coord_index = -1;
+static uint64_t coord_id;
+static int coord_nspinners = 0;
+static volatile sig_atomic_t coord_stop = 0;
+
+static void coord_lock()
+{
+    /* everything under the lock is a single store, so an instance killed
+     * holding it leaves nothing half-done */
+    if (pthread_mutex_lock(&coord->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&coord->lock);
+}
+
+static int coord_live(const struct coord_slot *s, uint64_t now)
+{
+    return s->id != 0 && now - s->heartbeat <= COORD_STALE;
+}
+
+/* the host CPU allocated to this instance, as a target for each of its
+ * ncpus spinners */
+static double coord_util(int ncpus)
+{
+    double alloc, util;
+
+    __atomic_load(&coord->slot[coord_index].alloc, &alloc, __ATOMIC_RELAXED);
+    util = alloc * get_cpu_count() / ncpus;
+    return util > 100 ? 100 : util;
+}
+
+/* add this spinner's CPU time since the last call to the instance's, and
+ * return the instance's total, in usec */
+static uint64_t coord_cpu_used()
+{
+    static uint64_t last = 0;
+    struct rusage ru;
+    uint64_t used;
+
+    getrusage(RUSAGE_SELF, &ru);
+    used = (uint64_t)(timeval_usec(&ru.ru_utime) + timeval_usec(&ru.ru_stime));
+    __atomic_fetch_add(&coord->slot[coord_index].cpu_usec, used - last,
+                       __ATOMIC_RELAXED);
+    last = used;
+    return __atomic_load_n(&coord->slot[coord_index].cpu_usec,
+                           __ATOMIC_RELAXED);
+}
+
+int coord_join(const char *name, double weight)
+{
+    char *path = coord_path;
+    struct stat st;
+    uint64_t now;
+    int fd, created = 1, i, e;
+
+    snprintf(path, sizeof(coord_path), "/lookbusy-%s", name);
+    if ((fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666)) == -1 &&
+        errno == EEXIST) {
+        created = 0;
+        fd = shm_open(path, O_RDWR, 0);
+    }
+    if (fd == -1) {
+        e = errno;
+        err("Couldn't open shared memory segment %s: %s\n", path,
+            strerror(e));
+        return e;
+    }
+    if (created) {
+        /* instances may run as different users */
+        fchmod(fd, 0666);
+        if (ftruncate(fd, sizeof(*coord)) == -1) {
+            e = errno;
+            perror("ftruncate");
+            shm_unlink(path);
+            close(fd);
+            return e;
+        }
+    } else {
+        /* the creator may not have sized it yet */
+        for (i = 0; i < 100; i++) {
+            if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*coord))
+                break;
+            usleep(10000);
+        }
+        if (i == 100) {
+            err("Shared memory segment %s isn't a lookbusy one\n", path);
+            close(fd);
+            return EINVAL;
+        }
+    }
+    coord = (struct coord_shared *)mmap(NULL, sizeof(*coord),
+                                        PROT_READ | PROT_WRITE, MAP_SHARED,
+                                        fd, 0);
+    if (coord == MAP_FAILED) {
+        e = errno;
+        perror("mmap");
+        close(fd);
+        coord = NULL;
+        return e;
+    }
+    close(fd);
+    if (created) {
+        pthread_mutexattr_t ma;
+        pthread_mutexattr_init(&ma);
+        pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&coord->lock, &ma);
+        coord->coordinator = -1;
+        __atomic_store_n(&coord->magic, COORD_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        for (i = 0; i < 100; i++) {
+            if (__atomic_load_n(&coord->magic, __ATOMIC_ACQUIRE) == COORD_MAGIC)
+                break;
+            usleep(10000);
+        }
+        if (i == 100) {
+            err("Shared memory segment %s isn't a lookbusy one\n", path);
+            munmap(coord, sizeof(*coord));
+            coord = NULL;
+            return EINVAL;
+        }
+    }
+
+    coord_id = rng_seed() | 1;
+    coord_lock();
+    now = mono_nsec();
+    /* a free slot if there is one, else that of an instance that
+     * stopped without leaving */
+    for (i = 0; i < COORD_SLOTS; i++)
+        if (coord->slot[i].id == 0)
+            break;
+    if (i == COORD_SLOTS)
+        for (i = 0; i < COORD_SLOTS; i++)
+            if (!coord_live(&coord->slot[i], now))
+                break;
+    if (i < COORD_SLOTS) {
+        struct coord_slot *s = &coord->slot[i];
+        s->heartbeat = now;
+        s->weight = weight;
+        s->nspinners = 0;
+        s->alloc = 0;
+        s->cpu_usec = 0;
+        s->id = coord_id;
+        coord_index = i;
+    }
+    pthread_mutex_unlock(&coord->lock);
+    if (coord_index == -1) {
+        err("All %d slots in %s are in use\n", COORD_SLOTS, path);
+        munmap(coord, sizeof(*coord));
+        coord = NULL;
+        return EBUSY;
+    }
+    say(1, "lookbusy (%d): joined %s as instance %d, weight %g\n", getpid(),
+           path, coord_index, weight);
+    return 0;
+}
+
+static void coord_on_signal(int sig)
+{
+    coord_stop = 1;
+}
+
+/* Divide the budget between the live instances by weight, none getting
+ * more than its spinners can use; what a capped instance can't take goes
+ * to the rest.
+ */
+static void coord_allocate(double budget, const int *live)
+{
+    const int hostcpus = get_cpu_count();
+    int capped[COORD_SLOTS], more = 1, i;
+    double left = budget;
+
+    memset(capped, 0, sizeof(capped));
+    while (more) {
+        double weights = 0;
+        more = 0;
+        for (i = 0; i < COORD_SLOTS; i++)
+            if (live[i] && !capped[i])
+                weights += coord->slot[i].weight;
+        for (i = 0; i < COORD_SLOTS && weights > 0; i++) {
+            struct coord_slot *s = &coord->slot[i];
+            double cap = 100. * s->nspinners / hostcpus, share;
+            if (!live[i] || capped[i])
+                continue;
+            share = left * s->weight / weights;
+            if (share >= cap) {
+                __atomic_store(&s->alloc, &cap, __ATOMIC_RELAXED);
+                capped[i] = 1;
+                left -= cap;
+                more = 1;
+                break;
+            }
+        }
+    }
+    for (i = 0; i < COORD_SLOTS; i++) {
+        double weights = 0, share;
+        int j;
+        if (!live[i] || capped[i])
+            continue;
+        for (j = 0; j < COORD_SLOTS; j++)
+            if (live[j] && !capped[j])
+                weights += coord->slot[j].weight;
+        share = left * coord->slot[i].weight / weights;
+        __atomic_store(&coord->slot[i].alloc, &share, __ATOMIC_RELAXED);
+    }
+}
+
+void coord_agent(long long util_l, long long util_h, long long dummy, void *dummyp, void *dummyp2)
+{
+    struct coord_slot *me = &coord->slot[coord_index];
+    const int hostcpus = get_cpu_count();
+    const uint64_t interval = (uint64_t)c_stats_interval * 1000000000;
+    uint64_t seen_id[COORD_SLOTS], seen_used[COORD_SLOTS];
+    uint64_t now, next, last = 0, last_report, host = 0;
+    /* over the reporting interval: host busy time, instances' CPU time */
+    uint64_t report_host = 0, report_wall = 0, report_used[COORD_SLOTS];
+    double other = 0, target = 0;
+    int live[COORD_SLOTS], leading = 0, i;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = coord_on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    say(2, "coord (%d): instance %d agent running\n", getpid(), coord_index);
+    next = last_report = mono_nsec();
+    while (! coord_stop) {
+        double alloc;
+
+        next += COORD_TICK;
+        sleep_until_nsec(next);
+        if (coord_stop)
+            break;
+        coord_lock();
+        now = mono_nsec();
+        if (me->id != coord_id) {
+            /* given up for dead while we were stopped, perhaps */
+            if (me->id != 0) {
+                pthread_mutex_unlock(&coord->lock);
+                err("coord (%d): instance %d's slot has been taken by"
+                    " another instance\n", getpid(), coord_index);
+                _exit(1);
+            }
+            say(1, "coord (%d): instance %d rejoining\n", getpid(),
+                   coord_index);
+            me->weight = c_coord_weight;
+            me->nspinners = coord_nspinners;
+            me->alloc = 0;
+            me->id = coord_id;
+        }
+        me->heartbeat = now;
+        if (coord->coordinator != coord_index &&
+            (coord->coordinator < 0 ||
+             !coord_live(&coord->slot[coord->coordinator], now))) {
+            say(1, "coord (%d): instance %d taking over as coordinator\n",
+                   getpid(), coord_index);
+            coord->coordinator = coord_index;
+        }
+        if (coord->coordinator != coord_index) {
+            leading = 0;
+            pthread_mutex_unlock(&coord->lock);
+            if (interval > 0 && now - last_report >= interval) {
+                __atomic_load(&me->alloc, &alloc, __ATOMIC_RELAXED);
+                say(2, "coord (%d): instance %d allocated %.1f%% of the"
+                       " host\n", getpid(), coord_index, alloc);
+                last_report = now;
+            }
+            continue;
+        }
+
+        if (!leading) {
+            /* a baseline to measure the next tick from */
+            for (i = 0; i < COORD_SLOTS; i++) {
+                seen_id[i] = coord->slot[i].id;
+                seen_used[i] = __atomic_load_n(&coord->slot[i].cpu_usec,
+                                               __ATOMIC_RELAXED);
+            }
+            host = get_cpu_busy_time();
+            last = now;
+            other = 0;
+            report_host = report_wall = 0;
+            memset(report_used, 0, sizeof(report_used));
+            last_report = now;
+            leading = 1;
+            pthread_mutex_unlock(&coord->lock);
+            continue;
+        }
+
+        {
+            const double wall = (now - last) / 1e3;
+            uint64_t h = get_cpu_busy_time();
+            double ours = 0, budget;
+
+            for (i = 0; i < COORD_SLOTS; i++) {
+                struct coord_slot *s = &coord->slot[i];
+                uint64_t u = __atomic_load_n(&s->cpu_usec, __ATOMIC_RELAXED);
+                if (s->id != 0 && !coord_live(s, now)) {
+                    say(1, "coord (%d): instance %d stopped responding\n",
+                           getpid(), i);
+                    s->id = 0;
+                }
+                live[i] = s->id != 0;
+                if (live[i] && s->id == seen_id[i]) {
+                    ours += u - seen_used[i];
+                    report_used[i] += u - seen_used[i];
+                } else {
+                    report_used[i] = 0;
+                }
+                seen_id[i] = s->id;
+                seen_used[i] = u;
+            }
+            /* /proc/stat only moves in whole ticks, and the spinners add
+             * their time once a control period, so the load from everything
+             * else is noisy over one of our ticks; smooth it */
+            other = .9 * other + .1 * (100. * (jiffies_to_usec(h - host) -
+                                               ours) / hostcpus / wall);
+            target = cpu_spin_compute_util(c_cpu_util_mode, util_l, util_h,
+                                           0);
+            budget = target - (other > 0 ? other : 0);
+            coord_allocate(budget < 0 ? 0 : budget > 100 ? 100 : budget,
+                           live);
+            report_host += h - host;
+            report_wall += now - last;
+            host = h;
+            last = now;
+        }
+        pthread_mutex_unlock(&coord->lock);
+
+        if (interval > 0 && now - last_report >= interval) {
+            const double wall = report_wall / 1e3;
+            int n = 0;
+            for (i = 0; i < COORD_SLOTS; i++)
+                n += live[i];
+            say(1, "coord (%d): %d instance(s); host %.1f%% busy against a"
+                   " target of %.1f%%, %.1f%% of it from other load\n",
+                   getpid(), n,
+                   100. * jiffies_to_usec(report_host) / hostcpus / wall,
+                   target, other > 0 ? other : 0);
+            for (i = 0; i < COORD_SLOTS; i++) {
+                if (!live[i])
+                    continue;
+                __atomic_load(&coord->slot[i].alloc, &alloc, __ATOMIC_RELAXED);
+                say(1, "coord (%d):   instance %d: weight %g, %d spinner(s),"
+                       " allocated %.1f%%, using %.1f%%\n", getpid(), i,
+                       coord->slot[i].weight, coord->slot[i].nspinners,
+                       alloc, 100. * report_used[i] / hostcpus / wall);
+                report_used[i] = 0;
+            }
+            report_host = report_wall = 0;
+            last_report = now;
+        }
+    }
+
+    /* leave, handing over at once rather than after a stale heartbeat, and
+     * take the segment away with us if we're the last */
+    coord_lock();
+    if (coord->coordinator == coord_index)
+        coord->coordinator = -1;
+    if (me->id == coord_id)
+        me->id = 0;
+    now = mono_nsec();
+    for (i = 0; i < COORD_SLOTS; i++)
+        if (coord_live(&coord->slot[i], now))
+            break;
+    if (i == COORD_SLOTS) {
+        say(2, "coord (%d): last instance out; removing %s\n", getpid(),
+               coord_path);
+        shm_unlink(coord_path);
+    }
+    pthread_mutex_unlock(&coord->lock);
+    fflush(stdout);
+    _exit(0);
+}
+
+/* what spinner index should aim for now, in percent */
+static double cpu_spin_target(lb_gen *g, int index, time_t curtime)
+{
+    double t;
+
+    if (g->cfg.scope == LB_HOST && replay != NULL)
+        return replay_cpu_util(index, g->nworkers);
+    if (g->cfg.scope == LB_HOST && coord != NULL)
+        return coord_util(g->nworkers);
+    t = get_target(g);
+    if (t > 100)
+        t = 100;
+    if (g->cfg.scope == LB_HOST)
+        return cpu_spin_compute_util(c_cpu_util_mode, t, c_cpu_util_h,
+                                     curtime);
+    return t;
+}
+
+/* The busy time, in usec, a spinner steers by: on a thread, its own; in
+ * a process, the instance's if coordinated, or else that of the CPU it
+ * keeps or of the whole host.
+ */
+static uint64_t cpu_spin_busy(lb_gen *g, int spin_cpu)
+{
+    if (g->cfg.scope != LB_HOST)
+        return thread_cpu_nsec() / 1000;
+    if (coord != NULL)
+        return coord_cpu_used();
+    if (spin_cpu >= 0)
+        return jiffies_to_usec(get_cpu_busy_time_on(spin_cpu));
+    return jiffies_to_usec(get_cpu_busy_time());
+}
+
+static int cpu_spin(lb_gen *g, int index)
+{
+    const int host = g->cfg.scope == LB_HOST;
+    const int ncpus = g->nworkers;
+    const int who = host ? RUSAGE_SELF : RUSAGE_THREAD;
+    uint64_t busycount;
+    const uint64_t minimum_cycles = 10000;
+    suseconds_t sleeptime;
+    int first = 1;
+    double util, target, calibrated;
+    /* following a coordinator's allocation, which can move a long way at
+     * once (from nothing, to begin with) */
+    const int coordinated = host && coord != NULL && replay == NULL;
+    int64_t adjust = 0;
+    int refine_left = index == 0 ? 50 : 0; /* control periods to observe */
+    double refine_best = 0;
+    /* correction to the estimated cost of system work, from measurement */
+    double sys_scale = 1.;
+    int split_periods = 0;
+    struct rusage ru, split_ru, report_ru;
+    uint64_t report_time, report_user = 0, report_sys = 0, cpu_last;
+    /* when replaying, each spinner keeps one CPU at its own target */
+    int spin_cpu = -1;
+    long long share = host ? ncpus : 1;
+    /* kept from one control period to the next */
+    uint64_t busytime = 0, busytime2 = 0, walltime = 0, walltime2 = 0;
+
+    if (host && replay != NULL && index < cpu_topo_load()) {
+        spin_cpu = cpu_topo[index].cpu;
+        share = 1;
+        cpu_pin("cpu_spin", spin_cpu);
+    }
+    target = get_target(g);
+    util = calibrated = cpu_spin_target(g, index, 0);
+
+    cpu_spin_calibrate(util, &busycount, &sleeptime);
+
+    getrusage(who, &split_ru);
+    report_ru = split_ru;
+    report_time = mono_nsec();
+    if (host)
+        get_cpu_times(&report_user, &report_sys);
+    cpu_last = thread_cpu_nsec();
+
+    say(2, "cpu_spin (%d): spinning cpu\n", getpid());
+    if (phase_sched != NULL)
+        phase_wait(index);
+    while (running(g)) {
+        struct timeval tv;
+        long long counter;
+        uint64_t spintime;
+        uint64_t sysiters = busycount * c_cpu_sys_pct / 100;
+
+        if (get_target(g) != target) {
+            /* retargeted: start over from the estimate, as at startup */
+            target = get_target(g);
+            util = calibrated = cpu_spin_target(g, index, 0);
+            cpu_spin_calibrate(util, &busycount, &sleeptime);
+            first = 1;
+        }
+        if (! first) {
+            uint64_t busy = (busytime2 - busytime) / share;
+            uint64_t wall = walltime2 - walltime;
+            double actual = (100 * busy) / wall;
+            int64_t oldadjust = adjust;
+            /* On a multi-CPU system there will be more than one spinner
+             * trying to hit the target utilization, so restrain the
+             * adjustment range so as to keep from collectively
+             * overcompensating
+             */
+            adjust = (int64_t)(((util - actual) * busycount) / 100. / share);
+            say(3, "cpu_spin (%d): last iter: count=%lld"
+                   " (~%lld of %lld); adjust=%lld\n",
+                   getpid(), busycount, busy, wall, 
+                   adjust);
+            if (adjust < 0 && busycount < -adjust) {
+                say(2, "cpu_spin (%d): usage at lower limit\n", getpid());
+                busycount = minimum_cycles;
+            } else if (adjust > 0 && UINT64_MAX - adjust < busycount) {
+                say(2, "cpu_spin (%d): usage at upper limit\n", getpid());
+            } else {
+                busycount += adjust;
+                if (busycount < minimum_cycles)
+                    busycount = minimum_cycles;
+            }
+
+            if ((adjust < 0 && oldadjust > 0) ||
+                (adjust > 0 && oldadjust < 0)) {
+                say(3, "cpu_spin (%d): adjusted approximately correctly\n",
+                       getpid());
+                say(3, "cpu_spin (%d): spin count %"PRIu64"\n", getpid(), busycount);
+            }
+        } else {
+            first = 0;
+        }
+        gettimeofday(&tv, NULL);
+        walltime = tv.tv_sec * 1000000 + tv.tv_usec;
+        busytime = cpu_spin_busy(g, spin_cpu);
+        gettimeofday(&tv, NULL);
+        spintime = tv.tv_sec * 1000000 + tv.tv_usec;
+
+        say(3, "cpu_spin (%d): spinning (0 to %"PRIu64")...\n", getpid(), busycount);
+        counter = busycount - sysiters;
+        cpu_kernels[c_cpu_kernel].fn(counter);
+        gettimeofday(&tv, NULL);
+        spintime = tv.tv_sec * 1000000 + tv.tv_usec - spintime;
+        if (sysiters > 0)
+            cpu_sys_work((uint64_t)(sysiters * sys_scale / cpu_sys_unit_iters));
+
+        /* the least-disturbed spin phase seen gives the best estimate of the
+         * kernel's true speed; short phases are too coarse to time */
+        if (refine_left > 0) {
+            if (spintime >= 1000 && counter * 1000000. / spintime > refine_best)
+                refine_best = counter * 1000000. / spintime;
+            if (--refine_left == 0 && refine_best > 0)
+                cpu_spin_refine(refine_best);
+        }
+
+        say(3, "cpu_spin (%d): sleeping...\n", getpid());
+        if (phase_sched != NULL)
+            phase_wait(index); /* the rest of the period, then the next */
+        else
+            usleep(sleeptime);
+        gettimeofday(&tv, NULL);
+        walltime2 = tv.tv_sec * 1000000 + tv.tv_usec;
+        busytime2 = cpu_spin_busy(g, spin_cpu);
+
+        util = cpu_spin_target(g, index, tv.tv_sec);
+        if (coordinated && fabs(util - calibrated) >= COORD_RECALIBRATE) {
+            /* start over from the estimate rather than creep there */
+            calibrated = util;
+            cpu_spin_calibrate(util, &busycount, &sleeptime);
+            first = 1;
+        }
+
+        /* Steer our own user/system split towards the requested one.  The
+         * kernel's accounting of the split is tick-sampled, so judge it over
+         * a second at a time, and only move part of the way each time.
+         */
+        if (c_cpu_sys_pct > 0 && ++split_periods >= 10) {
+            getrusage(who, &ru);
+            double du = timeval_usec(&ru.ru_utime) -
+                        timeval_usec(&split_ru.ru_utime);
+            double ds = timeval_usec(&ru.ru_stime) -
+                        timeval_usec(&split_ru.ru_stime);
+            if (du + ds > 0) {
+                double achieved = 100. * ds / (du + ds);
+                double ratio = achieved > 0 ? c_cpu_sys_pct / achieved : 2.;
+                if (ratio > 2.)
+                    ratio = 2.;
+                if (ratio < .5)
+                    ratio = .5;
+                sys_scale *= sqrt(ratio);
+                if (sys_scale < .05)
+                    sys_scale = .05;
+                if (sys_scale > 20.)
+                    sys_scale = 20.;
+                say(3, "cpu_spin (%d): system share %.1f%% of busy time;"
+                       " scale now %.2f\n", getpid(), achieved, sys_scale);
+            }
+            split_ru = ru;
+            split_periods = 0;
+        }
+
+        if (host && index == 0 && c_stats_interval > 0 &&
+            mono_nsec() - report_time >= (uint64_t)c_stats_interval * 1000000000) {
+            uint64_t now = mono_nsec(), user, sys;
+            double wall = (now - report_time) / 1e3;
+
+            getrusage(RUSAGE_SELF, &ru);
+            get_cpu_times(&user, &sys);
+            say(c_cpu_sys_pct > 0 ? 1 : 2,
+                "cpu_spin (%d): host %.1f%% user, %.1f%% system;"
+                " this spinner %.1f%% user, %.1f%% system\n", getpid(),
+                100. * jiffies_to_usec(user - report_user) / ncpus / wall,
+                100. * jiffies_to_usec(sys - report_sys) / ncpus / wall,
+                100. * (timeval_usec(&ru.ru_utime) -
+                        timeval_usec(&report_ru.ru_utime)) / wall,
+                100. * (timeval_usec(&ru.ru_stime) -
+                        timeval_usec(&report_ru.ru_stime)) / wall);
+            if (phase_sched != NULL)
+                phase_report();
+            report_ru = ru;
+            report_user = user;
+            report_sys = sys;
+            report_time = now;
+        }
+
+        account_cpu(g, &cpu_last);
+        if (index == 0)
+            window_update(g, mono_nsec(), host ?
+                          jiffies_to_usec(get_cpu_busy_time()) * 1000 :
+                          __atomic_load_n(&g->sh->cpu_ns, __ATOMIC_RELAXED));
+        sample();
+
+        /* "elapsed" here doesn't necessarily refer only to our own usage */
+        say(2, "cpu_spin (%d): %"PRIu64" iterations; %"PRIu64" usec of CPU"
+               " elapsed\n", getpid(), counter, busytime2 - busytime);
+    }
+    return 0;
+}
+
+/* this process's resident size, in bytes */
+static uint64_t own_rss()
+{
+    FILE *f;
+    unsigned long long size, resident = 0;
+
+    if ((f = fopen("/proc/self/statm", "r")) == NULL)
+        return 0;
+    if (fscanf(f, "%llu %llu", &size, &resident) != 2)
+        resident = 0;
+    fclose(f);
+    return resident * LB_PAGE_SIZE;
+}
+
+/* How much memory the replaying stirrer should hold now.  A host profile
+ * records everything in use on the host, so whatever else is running here
+ * counts towards it; a cgroup profile records just the cgroup, and is
+ * reproduced by the stirrer alone.
+ */
+static size_t replay_mem_target(size_t max)
+{
+    uint64_t want = replay->s[replay_index()].mem_kb * 1024;
+
+    if (! replay->cgroup) {
+        uint64_t used = host_mem_used_kb(NULL) * 1024, own = own_rss();
+        uint64_t other = used > own ? used - own : 0;
+        want = want > other ? want - other : 0;
+    }
+    return want > max ? max : (size_t)want;
+}
+
+/* How much memory a --mem-mode shape calls for now, between --mem-min
+ * and max.
+ */
+static size_t mem_shape_target(size_t max)
+{
+    double period = (double)c_mem_period * 1e9;
+    double t = (double)(mono_nsec() - mem_shape_start), f;
+    size_t min = c_mem_min < max ? c_mem_min : max;
+
+    switch (c_mem_mode) {
+        case MEM_MODE_RAMP:
+            f = t >= period ? 1 : t / period;
+            break;
+        case MEM_MODE_COSINE:
+            f = (1 - cos(fmod(t, period) / period * PI * 2)) / 2;
+            break;
+        case MEM_MODE_SAWTOOTH:
+            f = fmod(t, period) / period;
+            break;
+        default:
+            f = 1;
+            break;
+    }
+    return min + (size_t)((double)(max - min) * f);
+}
+
+/* the bytes of buf's first len mincore() finds resident; if touch is set,
+ * touching any which aren't first */
+static size_t mem_resident(char *buf, size_t len, unsigned char *vec,
+                           int touch)
+{
+    const size_t pagesize = LB_PAGE_SIZE;
+    size_t p, missing = 0, resident = 0;
+
+    if (len == 0 || mincore(buf, len, vec) == -1)
+        return 0;
+    if (touch) {
+        for (p = 0; p < len / pagesize; p++) {
+            if (!(vec[p] & 1)) {
+                buf[p * pagesize] = (char)(p & 0xff);
+                missing++;
+            }
+        }
+        if (missing > 0 && mincore(buf, len, vec) == -1)
+            return 0;
+    }
+    for (p = 0; p < len / pagesize; p++)
+        if (vec[p] & 1)
+            resident++;
+    return resident * pagesize;
+}
+
+/* The memory stirrer: holds a working set in the generator's buffer and
+ * keeps it active, copying a page at a time between two cycling positions.
+ * The working set is populated by dirtying it and shrunk with
+ * MADV_DONTNEED.  It's normally the target, with any page found to have
+ * gone (swapped out, say) touched again.  For --replay and the --mem-mode
+ * shapes, it's whatever brings the process's resident size to theirs
+ * instead: each adjustment corrects by the difference between the target
+ * and the measured RSS, which takes in the process's own overhead and any
+ * of the buffer swapped out or reclaimed.
+ */
+static int mem_stir(lb_gen *g)
+{
+    const size_t pagesize = LB_PAGE_SIZE;
+    const size_t sz = g->reserved / pagesize * pagesize;
+    const int track = g->cfg.scope == LB_HOST &&
+                      (replay != NULL || c_mem_mode != MEM_MODE_FIXED);
+    char *buf = g->buf;
+    unsigned char *vec;
+    size_t active = 0, sp = 0, dp = 0;
+    uint64_t next_adjust = 0, next_report = 0, cpu_last = thread_cpu_nsec();
+    double abserr = 0;
+    unsigned long nadjust = 0;
+
+    if ((vec = (unsigned char *)malloc(sz / pagesize + 1)) == NULL)
+        return ENOMEM;
+    if (!track)
+        say(1, "mem_stir (%d): stirring %llu bytes...\n", getpid(),
+               (unsigned long long)get_target(g));
+    else if (replay != NULL)
+        say(1, "mem_stir (%d): replaying memory profile, up to %llu bytes\n",
+               getpid(), (unsigned long long)sz);
+    else
+        say(1, "mem_stir (%d): %s memory shape between %llu and %llu bytes"
+               " over %ds\n", getpid(), mem_mode_names[c_mem_mode],
+               (unsigned long long)c_mem_min, (unsigned long long)sz,
+               c_mem_period);
+
+    while (running(g)) {
+        uint64_t now = mono_nsec();
+
+        if (now >= next_adjust) {
+            size_t target, next, p;
+            uint64_t rss = 0;
+
+            if (track) {
+                double want;
+
+                target = replay != NULL ? replay_mem_target(sz) :
+                                          mem_shape_target(sz);
+                rss = own_rss();
+                want = (double)active + (double)target - (double)rss;
+                if (want < 0)
+                    want = 0;
+                next = want > sz ? sz : (size_t)want / pagesize * pagesize;
+            } else {
+                double t = get_target(g);
+
+                target = t > sz ? sz : (size_t)t;
+                next = target / pagesize * pagesize;
+            }
+            if (next > active) {
+                say(2, "mem_stir (%d): dirtying buffer...", getpid());
+                for (p = active; p < next; p++)
+                    buf[p] = (char)(p & 0xff);
+                say(2, "done\n");
+            } else if (next < active) {
+                madvise(buf + next, active - next, MADV_DONTNEED);
+            }
+            if (next != active)
+                say(2, "mem_stir (%d): working set now %llu bytes\n",
+                       getpid(), (unsigned long long)next);
+            active = next;
+            __atomic_store_n(&g->sh->resident,
+                             mem_resident(buf, active, vec, !track),
+                             __ATOMIC_RELAXED);
+            next_adjust = now + LB_PERIOD;
+
+            if (track) {
+                abserr += fabs((double)target - (double)rss);
+                nadjust++;
+                if (c_stats_interval > 0 && now >= next_report) {
+                    if (next_report != 0)
+                        say(1, "mem_stir (%d): target %llu KB, resident"
+                               " %llu KB (mean error %.0f KB)\n", getpid(),
+                               (unsigned long long)target / 1024,
+                               (unsigned long long)rss / 1024,
+                               abserr / nadjust / 1024);
+                    abserr = 0;
+                    nadjust = 0;
+                    next_report = now + (uint64_t)c_stats_interval * 1000000000;
+                }
+            }
+            account_cpu(g, &cpu_last);
+        }
+
+        if (active >= 2 * pagesize) {
+            if (sp + pagesize > active)
+                sp = 0;
+            if (dp + pagesize > active)
+                dp = 0;
+#ifdef HAVE_MEMMOVE
+            memmove(buf + dp, buf + sp, pagesize);
+#else
+            memcpy(buf + dp, buf + sp, pagesize);
+#endif
+            sp += pagesize * 1;
+            dp += pagesize * 5;
+        }
+        sample();
+        usleep(c_mem_stir_sleep);
+    }
+    free(vec);
+    return 0;
+}
+
+/* Write data with controlled entropy, for --disk-compress and
+ * --disk-dedupe.  Random bytes are generated once into a pool per worker;
+ * each block is then assembled from it one 4KB segment at a time (the
+ * usual granularity of deduplicating storage), taking 1/compress of each
+ * segment from the pool and zero-filling the rest, and stamping the
+ * segment with the block's identity so that no two segments match unless
+ * they are meant to.  A block's contents depend only on its identity:
+ * fresh identities make unique blocks, and reusing a recently written one
+ * makes an exact duplicate, as happens for all but 1/dedupe of the blocks.
+ * Assembly costs a memcpy per segment, so the device stays the bottleneck.
+ */
+#define DATA_SEGMENT 4096
+#define DATA_POOL_SIZE (4 * 1024 * 1024)
+#define DATA_DEDUPE_WINDOW 1024 /* recent blocks duplicates are drawn from */
+
+struct data_gen {
+    char *pool;
+    uint64_t rng;
+    uint64_t next_id;
+    uint64_t unique, total;
+    uint64_t window;
+};
+
+static int data_gen_init(struct data_gen *g, uint64_t nwrites)
+{
+    uint64_t *p;
+    size_t i;
+
+    if ((g->pool = (char *)malloc(DATA_POOL_SIZE)) == NULL)
+        return ENOMEM;
+    g->rng = rng_seed();
+    p = (uint64_t *)g->pool;
+    for (i = 0; i < DATA_POOL_SIZE / sizeof(*p); i++)
+        p[i] = rng_next(&g->rng);
+    g->next_id = rng_next(&g->rng);
+    g->unique = g->total = 0;
+    /* nwrites blocks make one pass over the file.  Duplicates are of
+     * blocks from the last sixteenth of a pass or so: those are still
+     * there to match, and few enough new identities are drawn on from
+     * blocks already overwritten to keep the ratio close. */
+    g->window = (uint64_t)(nwrites / 16 /
+                           (c_disk_dedupe > 1 ? c_disk_dedupe : 1));
+    if (g->window > DATA_DEDUPE_WINDOW)
+        g->window = DATA_DEDUPE_WINDOW;
+    if (g->window == 0)
+        g->window = 1;
+    return 0;
+}
+
+static void data_gen_fill(struct data_gen *g, char *block, size_t len)
+{
+    uint64_t id, seg;
+    size_t off;
+
+    if (c_disk_dedupe > 1 && g->unique > 0 &&
+        rng_uniform(&g->rng) > 1 / c_disk_dedupe) {
+        uint64_t window = g->unique < g->window ? g->unique : g->window;
+        id = g->next_id - 1 - rng_next(&g->rng) % window;
+    } else {
+        id = g->next_id++;
+        g->unique++;
+    }
+    g->total++;
+
+    for (off = 0, seg = 0; off < len; off += DATA_SEGMENT, seg++) {
+        size_t n = len - off < DATA_SEGMENT ? len - off : DATA_SEGMENT;
+        size_t r = c_disk_compress > 1 ? (size_t)(n / c_disk_compress) : n;
+        uint64_t h = id * 0x9e3779b97f4a7c15ULL + seg;
+
+        /* splitmix64's finalizer, to scatter segments over the pool */
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        memcpy(block + off,
+               g->pool + (h % ((DATA_POOL_SIZE - DATA_SEGMENT) / 8)) * 8, r);
+        memset(block + off + r, 0, n - r);
+        if (n >= 2 * sizeof(id)) {
+            memcpy(block + off, &id, sizeof(id));
+            memcpy(block + off + sizeof(id), &seg, sizeof(seg));
+        }
+    }
+}
+
+/* Disk churn for --replay: reads and writes paced to the profile's IOPS,
+ * in blocks sized to match its bandwidth, shared evenly among the disk
+ * generators.  Written blocks are pushed to the device straight away and
+ * blocks are dropped from the page cache before being read back, so that
+ * the device sees roughly the operations the profile recorded.
+ */
+#define DISK_REPLAY_TICK 100000000ULL /* nsec */
+#define DISK_REPLAY_MAX_BLOCK (1024 * 1024)
+
+static size_t disk_replay_block(uint64_t kbps, uint64_t *iops, off_t sz,
+                                size_t bs)
+{
+    if (*iops == 0 && kbps > 0)
+        *iops = (kbps * 1024 + bs - 1) / bs;
+    else if (*iops > 0)
+        bs = (size_t)(kbps * 1024 / *iops);
+    if (bs < 512)
+        bs = 512;
+    if (bs > DISK_REPLAY_MAX_BLOCK)
+        bs = DISK_REPLAY_MAX_BLOCK;
+    if ((off_t)bs > sz)
+        bs = (size_t)sz;
+    return bs;
+}
+
+static int disk_churn_replay(lb_gen *g)
+{
+    const int fd = g->fd;
+    const off_t sz = g->fsize;
+    const int entropy = c_disk_compress > 0 || c_disk_dedupe > 0;
+    double rd_credit = 0, wr_credit = 0;
+    off_t rpos = 0, wpos = 0;
+    uint64_t last = mono_nsec(), next = last, cpu_last = thread_cpu_nsec();
+    struct data_gen gen;
+    char *block;
+    int e = 0;
+
+    if ((block = (char *)malloc(DISK_REPLAY_MAX_BLOCK)) == NULL)
+        return ENOMEM;
+    memset(block, 0x5a, DISK_REPLAY_MAX_BLOCK);
+    if (entropy && data_gen_init(&gen, sz / g->cfg.block_size) != 0) {
+        free(block);
+        return ENOMEM;
+    }
+    say(2, "disk_churn (%d): replaying disk profile on %s\n", getpid(),
+           g->path);
+
+    while (running(g)) {
+        const struct profile_sample *ps = &replay->s[replay_index()];
+        uint64_t rd_iops = ps->rd_iops, wr_iops = ps->wr_iops, now;
+        size_t rbs = disk_replay_block(ps->rd_kbps, &rd_iops, sz,
+                                       g->cfg.block_size);
+        size_t wbs = disk_replay_block(ps->wr_kbps, &wr_iops, sz,
+                                       g->cfg.block_size);
+        double dt;
+
+        next += DISK_REPLAY_TICK;
+        sleep_until_nsec(next);
+        now = mono_nsec();
+        dt = (now - last) / 1e9;
+        last = now;
+
+        /* don't try to catch up on more than a second's worth */
+        wr_credit += (double)wr_iops * dt / c_disk_share;
+        if (wr_credit > wr_iops)
+            wr_credit = wr_iops;
+        rd_credit += (double)rd_iops * dt / c_disk_share;
+        if (rd_credit > rd_iops)
+            rd_credit = rd_iops;
+
+        for (; wr_credit >= 1; wr_credit--) {
+            if (wpos + (off_t)wbs > sz)
+                wpos = 0;
+            if (entropy)
+                data_gen_fill(&gen, block, wbs);
+            if (pwrite(fd, block, wbs, wpos) == -1) {
+                e = errno;
+                err("disk_churn (%d): error writing to %s at %ld: %s\n",
+                    getpid(), g->path, (long)wpos, strerror(e));
+                goto out;
+            }
+#ifdef SYNC_FILE_RANGE_WRITE
+            sync_file_range(fd, wpos, wbs, SYNC_FILE_RANGE_WRITE);
+#endif
+            __atomic_add_fetch(&g->sh->written, wbs, __ATOMIC_RELAXED);
+            wpos += wbs;
+        }
+        for (; rd_credit >= 1; rd_credit--) {
+            if (rpos + (off_t)rbs > sz)
+                rpos = 0;
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(fd, rpos, rbs, POSIX_FADV_DONTNEED);
+#endif
+            if (pread(fd, block, rbs, rpos) == -1) {
+                e = errno;
+                err("disk_churn (%d): error reading from %s at %ld: %s\n",
+                    getpid(), g->path, (long)rpos, strerror(e));
+                goto out;
+            }
+            __atomic_add_fetch(&g->sh->read, rbs, __ATOMIC_RELAXED);
+            rpos += rbs;
+        }
+        window_update(g, now, __atomic_load_n(&g->sh->written,
+                                              __ATOMIC_RELAXED));
+        account_cpu(g, &cpu_last);
+        sample();
+    }
+out:
+    if (entropy)
+        free(gen.pool);
+    free(block);
+    return e;
+}
+
+/* lookbusy's disk churn, for LB_HOST: each iteration writes a block and
+ * reads one back, from two independently cycling positions in the file,
+ * then pauses c_disk_churn_sleep ms.  Nothing is flushed; what reaches the
+ * device is up to the page cache.
+ */
+static int disk_churn_host(lb_gen *g)
+{
+    const size_t bs = g->cfg.block_size;
+    const off_t sz = g->fsize;
+    const int entropy = c_disk_compress > 0 || c_disk_dedupe > 0;
+    uint64_t cpu_last = thread_cpu_nsec();
+    off_t rpos = 0, wpos = 0;
+    int witer = 0, e = 0;
+    struct data_gen gen;
+    char *block;
+
+    if ((block = (char *)malloc(bs)) == NULL)
+        return ENOMEM;
+    if (entropy) {
+        if (data_gen_init(&gen, sz / (c_disk_churn_step_size * 2)) != 0) {
+            free(block);
+            return ENOMEM;
+        }
+        say(1, "disk_churn (%d): writing data compressible %.1f:1,"
+               " deduplicable %.1f:1\n", getpid(),
+               c_disk_compress > 1 ? c_disk_compress : 1.,
+               c_disk_dedupe > 1 ? c_disk_dedupe : 1.);
+    }
+    say(1, "disk_churn (%d): churning disk on %s (%lld bytes)\n", getpid(),
+           g->path, (long long)sz);
+
+    while (running(g)) {
+        size_t p;
+        ssize_t r;
+
+        if (rpos >= sz) {
+            say(2, "disk_churn (%d) reader reached EOF at %ld\n",
+                   getpid(), (long)rpos);
+            rpos = 0;
+        }
+        if (wpos >= sz) {
+            say(2, "disk_churn (%d) writer reached EOF at %ld\n",
+                   getpid(), (long)wpos);
+            wpos = 0;
+            witer++;
+        }
+
+        if (entropy)
+            data_gen_fill(&gen, block, bs);
+        else
+            for (p = 0; p < bs; p++)
+                block[p] = (char)((witer | (int)p) & 0xff);
+        if (pwrite(g->fd, block, bs, wpos) == -1) {
+            e = errno;
+            err("disk_churn (%d): error writing to %s at %ld: %s\n",
+                getpid(), g->path, (long)wpos, strerror(e));
+            break;
+        }
+        __atomic_add_fetch(&g->sh->written, bs, __ATOMIC_RELAXED);
+        wpos += c_disk_churn_step_size * 2;
+
+        r = pread(g->fd, block, bs, rpos);
+        if (r == -1) {
+            e = errno;
+            err("disk_churn (%d): error reading from %s at %ld: %s\n",
+                getpid(), g->path, (long)rpos, strerror(e));
+            break;
+        }
+        if (r == 0) {
+            say(1, "disk_churn (%d): reader reached EOF early (at %ld)\n",
+                   getpid(), (long)rpos);
+            rpos = 0;
+        }
+        __atomic_add_fetch(&g->sh->read, r, __ATOMIC_RELAXED);
+        rpos += c_disk_churn_step_size;
+
+        window_update(g, mono_nsec(), __atomic_load_n(&g->sh->written,
+                                                      __ATOMIC_RELAXED));
+        account_cpu(g, &cpu_last);
+        sample();
+        usleep(c_disk_churn_sleep * 1000);
+    }
+    if (entropy)
+        free(gen.pool);
+    free(block);
+    return e;
+}
+
+/* The disk engine for LB_THREAD: at the target rate in bytes/sec, write
+ * blocks through the file, flush them, and read each one back after
+ * dropping it from the page cache, so that both reach the device.  Writes
+ * are the churn pattern, or controlled-entropy data as for disk_churn_host().
+ */
+static int disk_churn(lb_gen *g)
+{
+    const size_t bs = g->cfg.block_size;
+    const uint64_t nblocks = g->fsize / bs;
+    const int entropy = c_disk_compress > 0 || c_disk_dedupe > 0;
+    uint64_t start = mono_nsec(), next = start, done = 0;
+    uint64_t cpu_last = thread_cpu_nsec();
+    double last_target = -1;
+    off_t pos = 0;
+    int witer = 0, e = 0;
+    struct data_gen gen;
+    char *block;
+
+    if ((block = (char *)malloc(bs)) == NULL)
+        return ENOMEM;
+    if (entropy) {
+        if (data_gen_init(&gen, nblocks) != 0) {
+            free(block);
+            return ENOMEM;
+        }
+        say(1, "disk_churn (%d): writing data compressible %.1f:1,"
+               " deduplicable %.1f:1\n", getpid(),
+               c_disk_compress > 1 ? c_disk_compress : 1.,
+               c_disk_dedupe > 1 ? c_disk_dedupe : 1.);
+    }
+    say(1, "disk_churn (%d): churning disk on %s (%lld bytes)\n", getpid(),
+           g->path, (long long)g->fsize);
+
+    while (running(g)) {
+        double t = get_target(g), due;
+        uint64_t now;
+
+        /* pace from here on at the new rate */
+        if (t != last_target) {
+            start = mono_nsec();
+            done = 0;
+            last_target = t;
+        }
+        due = t * (mono_nsec() - start) / 1e9 / bs;
+        /* don't try to catch up on more than a second's worth, nor take
+         * more than a pass over the file at a time */
+        if (due - done > t / bs + 1)
+            done = (uint64_t)(due - t / bs);
+        if (due - done > nblocks)
+            due = done + nblocks;
+        if (done < due) {
+            off_t from = pos;
+            uint64_t n = 0, i;
+            size_t p;
+
+            /* this tick's writes, then their reads, so that one flush
+             * covers them all and the reads find them clean to drop */
+            for (; done < due; done++, n++) {
+                if (pos + (off_t)bs > g->fsize) {
+                    say(2, "disk_churn (%d) writer reached EOF at %ld\n",
+                           getpid(), (long)pos);
+                    pos = 0;
+                    witer++;
+                }
+                if (entropy)
+                    data_gen_fill(&gen, block, bs);
+                else
+                    for (p = 0; p < bs; p++)
+                        block[p] = (char)((witer | (int)p) & 0xff);
+                if (pwrite(g->fd, block, bs, pos) == -1) {
+                    e = errno;
+                    err("disk_churn (%d): error writing to %s at %ld: %s\n",
+                        getpid(), g->path, (long)pos, strerror(e));
+                    goto out;
+                }
+                __atomic_add_fetch(&g->sh->written, bs, __ATOMIC_RELAXED);
+                pos += bs;
+            }
+            fdatasync(g->fd);
+            for (i = 0, pos = from; i < n; i++) {
+                if (pos + (off_t)bs > g->fsize)
+                    pos = 0;
+                posix_fadvise(g->fd, pos, bs, POSIX_FADV_DONTNEED);
+                if (pread(g->fd, block, bs, pos) == -1) {
+                    e = errno;
+                    err("disk_churn (%d): error reading from %s at %ld: %s\n",
+                        getpid(), g->path, (long)pos, strerror(e));
+                    goto out;
+                }
+                __atomic_add_fetch(&g->sh->read, bs, __ATOMIC_RELAXED);
+                pos += bs;
+            }
+        }
+        now = mono_nsec();
+        window_update(g, now, __atomic_load_n(&g->sh->written,
+                                              __ATOMIC_RELAXED));
+        account_cpu(g, &cpu_last);
+        sample();
+        next += LB_DISK_TICK;
+        if (next < now)
+            next = now;
+        else
+            sleep_until_nsec(next);
+    }
+out:
+    if (entropy)
+        free(gen.pool);
+    free(block);
+    return e;
+}
+
+int lb_workers(lb_gen *g)
+{
+    return g->nworkers;
+}
+
+int lb_run(lb_gen *g, int index)
+{
+    switch (g->cfg.kind) {
+        case LB_CPU:
+            return cpu_spin(g, index);
+        case LB_MEM:
+            return mem_stir(g);
+        case LB_DISK:
+            if (g->cfg.scope == LB_HOST && replay != NULL)
+                return disk_churn_replay(g);
+            if (g->cfg.scope == LB_HOST)
+                return disk_churn_host(g);
+            return disk_churn(g);
+    }
+    return EINVAL;
+}
+
+/* the scratch file, or the named file, for a LB_DISK generator */
+static int disk_open(lb_gen *g)
+{
+    const char *path = g->cfg.path ? g->cfg.path : "/tmp";
+    struct stat st;
+
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if ((g->path = (char *)malloc(strlen(path) + 32)) == NULL)
+            return ENOMEM;
+        sprintf(g->path, "%s/lb.%d.XXXXXX", path, (int)getpid());
+        if ((g->fd = mkstemp(g->path)) == -1)
+            return errno;
+        /* gone once closed, however the caller goes */
+        unlink(g->path);
+    } else {
+        if ((g->path = strdup(path)) == NULL)
+            return ENOMEM;
+        if ((g->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1)
+            return errno;
+    }
+    if (ftruncate(g->fd, g->fsize) == -1)
+        return errno;
+    return 0;
+}
+
+int lb_create(const struct lb_config *cfg, lb_gen **gen)
+{
+    pthread_mutexattr_t ma;
+    lb_gen *g;
+    int e;
+
+    if (cfg == NULL || gen == NULL || cfg->target < 0)
+        return EINVAL;
+    if (cfg->kind != LB_CPU && cfg->kind != LB_MEM && cfg->kind != LB_DISK)
+        return EINVAL;
+    if (cfg->scope != LB_THREAD && cfg->scope != LB_HOST)
+        return EINVAL;
+    if ((g = (lb_gen *)calloc(1, sizeof(*g))) == NULL)
+        return ENOMEM;
+    g->cfg = *cfg;
+    g->fd = -1;
+    g->hostcpus = get_cpu_count();
+
+    /* shared with LB_HOST workers across fork() */
+    g->sh = (struct lb_shared *)mmap(NULL, sizeof(*g->sh),
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g->sh == MAP_FAILED) {
+        e = errno;
+        g->sh = NULL;
+        free(g);
+        return e;
+    }
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    e = pthread_mutex_init(&g->sh->lock, &ma);
+    pthread_mutexattr_destroy(&ma);
+    if (e != 0) {
+        munmap(g->sh, sizeof(*g->sh));
+        free(g);
+        return e;
+    }
+    __atomic_store(&g->sh->target, &g->cfg.target, __ATOMIC_RELAXED);
+
+    switch (cfg->kind) {
+        case LB_CPU:
+            g->nworkers = cfg->threads;
+            if (g->nworkers <= 0 && cfg->scope == LB_HOST && replay != NULL) {
+                /* one spinner per recorded CPU, as far as this host has
+                 * them */
+                int online = cpu_topo_load();
+
+                if (online <= 0)
+                    online = g->hostcpus;
+                g->nworkers = replay->ncpus < online ? replay->ncpus : online;
+            }
+            if (g->nworkers <= 0)
+                g->nworkers = g->hostcpus;
+            break;
+        case LB_MEM:
+            g->nworkers = 1;
+            g->reserved = (size_t)(cfg->size ? cfg->size : cfg->target);
+            if (g->reserved == 0 || g->reserved < cfg->target) {
+                lb_destroy(g);
+                return EINVAL;
+            }
+            g->buf = (char *)mmap(NULL, g->reserved, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                  -1, 0);
+            if (g->buf == MAP_FAILED) {
+                e = errno;
+                g->buf = NULL;
+                lb_destroy(g);
+                return e;
+            }
+            break;
+        case LB_DISK:
+            g->nworkers = 1;
+            g->fsize = cfg->size ? (off_t)cfg->size : LB_DEFAULT_DISK_SIZE;
+            if (g->cfg.block_size == 0)
+                g->cfg.block_size = LB_DEFAULT_BLOCK_SIZE;
+            if ((off_t)g->cfg.block_size > g->fsize) {
+                lb_destroy(g);
+                return EINVAL;
+            }
+            if ((e = disk_open(g)) != 0) {
+                lb_destroy(g);
+                return e;
+            }
+            break;
+    }
+    if ((g->tids = (pthread_t *)calloc(g->nworkers, sizeof(pthread_t))) == NULL ||
+        (g->pids = (pid_t *)calloc(g->nworkers, sizeof(pid_t))) == NULL) {
+        lb_destroy(g);
+        return ENOMEM;
+    }
+    *gen = g;
+    return 0;
+}
+
+int lb_prepare(lb_gen *g)
+{
+    int e;
+
+    if (running(g))
+        return EBUSY;
+    if (g->cfg.kind == LB_CPU) {
+        if (cpu_spin_rate == 0)
+            cpu_spin_prepare();
+        if (c_cpu_sys_pct > 0 && cpu_sys_fd == -1 &&
+            (e = cpu_sys_prepare()) != 0)
+            return e;
+        if (g->cfg.scope == LB_HOST && c_cpu_phase != CPU_PHASE_FREE &&
+            phase_sched == NULL && (e = phase_prepare(g->nworkers)) != 0)
+            return e;
+        if (g->cfg.scope == LB_HOST && coord != NULL) {
+            coord_nspinners = g->nworkers;
+            coord->slot[coord_index].nspinners = coord_nspinners;
+        }
+    }
+    g->start = mono_nsec();
+    gen_lock(g);
+    g->sh->window.t0 = 0;
+    g->sh->window.rate = 0;
+    pthread_mutex_unlock(&g->sh->lock);
+    __atomic_store_n(&g->sh->running, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+struct lb_thread_arg {
+    lb_gen *g;
+    int index;
+};
+
+static void *lb_thread(void *arg)
+{
+    struct lb_thread_arg a = *(struct lb_thread_arg *)arg;
+
+    free(arg);
+    return (void *)(intptr_t)lb_run(a.g, a.index);
+}
+
+int lb_start(lb_gen *g)
+{
+    int e;
+
+    if ((e = lb_prepare(g)) != 0)
+        return e;
+    for (g->nstarted = 0; g->nstarted < g->nworkers; g->nstarted++) {
+        const int i = g->nstarted;
+
+        if (g->cfg.scope == LB_HOST) {
+            fflush(stdout);
+            if ((g->pids[i] = fork()) == -1) {
+                e = errno;
+                goto fail;
+            }
+            if (g->pids[i] == 0) {
+                /* not to outlive the caller, whatever becomes of it */
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                e = lb_run(g, i);
+                fflush(stdout);
+                _exit(e == 0 ? 0 : 1);
+            }
+        } else {
+            struct lb_thread_arg *a =
+                (struct lb_thread_arg *)malloc(sizeof(*a));
+
+            if (a == NULL) {
+                e = ENOMEM;
+                goto fail;
+            }
+            a->g = g;
+            a->index = i;
+            if ((e = pthread_create(&g->tids[i], NULL, lb_thread, a)) != 0) {
+                free(a);
+                goto fail;
+            }
+        }
+    }
+    return 0;
+
+fail:
+    lb_stop(g);
+    return e;
+}
+
+int lb_retarget(lb_gen *g, double target)
+{
+    if (target < 0 || (g->cfg.kind == LB_MEM && target > g->reserved))
+        return EINVAL;
+    __atomic_store(&g->sh->target, &target, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int lb_stats(lb_gen *g, struct lb_stats *st)
+{
+    double rate;
+
+    memset(st, 0, sizeof(*st));
+    st->target = get_target(g);
+    gen_lock(g);
+    rate = g->sh->window.rate;
+    pthread_mutex_unlock(&g->sh->lock);
+    switch (g->cfg.kind) {
+        case LB_CPU:
+            /* CPU seconds per second, as a percentage per thread, or of
+             * the whole host */
+            st->achieved = rate / 1e9 * 100 /
+                           (g->cfg.scope == LB_HOST ? g->hostcpus :
+                                                      g->nworkers);
+            break;
+        case LB_MEM:
+            st->achieved = (double)__atomic_load_n(&g->sh->resident,
+                                                   __ATOMIC_RELAXED);
+            break;
+        case LB_DISK:
+            st->achieved = rate;
+            break;
+    }
+    st->elapsed = g->start ? (mono_nsec() - g->start) / 1e9 : 0;
+    st->cpu_seconds = __atomic_load_n(&g->sh->cpu_ns, __ATOMIC_RELAXED) / 1e9;
+    st->bytes_written = __atomic_load_n(&g->sh->written, __ATOMIC_RELAXED);
+    st->bytes_read = __atomic_load_n(&g->sh->read, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int lb_stop(lb_gen *g)
+{
+    int i;
+
+    __atomic_store_n(&g->sh->running, 0, __ATOMIC_RELAXED);
+    for (i = 0; i < g->nstarted; i++) {
+        if (g->cfg.scope == LB_HOST)
+            waitpid(g->pids[i], NULL, 0);
+        else
+            pthread_join(g->tids[i], NULL);
+    }
+    g->nstarted = 0;
+    if (g->cfg.kind == LB_MEM) {
+        /* hand the memory back; a restart repopulates it */
+        madvise(g->buf, g->reserved, MADV_DONTNEED);
+        __atomic_store_n(&g->sh->resident, 0, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+void lb_destroy(lb_gen *g)
+{
+    if (g == NULL)
+        return;
+    lb_stop(g);
+    if (g->buf != NULL)
+        munmap(g->buf, g->reserved);
+    if (g->fd != -1)
+        close(g->fd);
+    pthread_mutex_destroy(&g->sh->lock);
+    munmap(g->sh, sizeof(*g->sh));
+    free(g->path);
+    free(g->tids);
+    free(g->pids);
+    free(g);
+}
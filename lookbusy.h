@@ -0,0 +1,97 @@
+/* $Id$
+ *
+ * lookbusy.h -- in-process load generators, for driving CPU, memory and
+ *               disk load from within a test harness or other program.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * A generator is created from a configuration, started, and then runs
+ * until it is stopped: on threads of its own in the calling process,
+ * steering their own consumption (LB_THREAD), or in processes forked for
+ * it, steering the host's as the lookbusy program does (LB_HOST).  While
+ * it runs, its target may be changed and its statistics read at any time,
+ * from any thread.  All calls returning int return 0 on success, or an
+ * errno value.
+ *
+ *     struct lb_config cfg = { LB_CPU };
+ *     lb_gen *g;
+ *
+ *     cfg.threads = 2;
+ *     cfg.target = 40;
+ *     lb_create(&cfg, &g);
+ *     lb_start(g);
+ *     ...
+ *     lb_retarget(g, 80);
+ *     ...
+ *     lb_stop(g);
+ *     lb_destroy(g);
+ */
+
+#ifndef LOOKBUSY_H
+#define LOOKBUSY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum lb_kind {
+    LB_CPU = 0,         /* target: percent of a CPU, per thread (LB_THREAD),
+                         *   or of each of the host's CPUs (LB_HOST) */
+    LB_MEM,             /* target: bytes to hold resident */
+    LB_DISK             /* target: bytes per second to write and read back
+                         *   (LB_THREAD); with LB_HOST, the churn runs at
+                         *   lookbusy's -D pace, and the target is unused */
+};
+
+enum lb_scope {
+    LB_THREAD = 0,      /* threads of the caller; only their own use counts */
+    LB_HOST             /* forked processes; LB_CPU makes up whatever the
+                         *   rest of the host leaves of its target, as
+                         *   measured from /proc/stat */
+};
+
+struct lb_config {
+    enum lb_kind kind;
+    double target;
+    int threads;        /* LB_CPU: spinners (0: one per CPU) */
+    uint64_t size;      /* LB_MEM: most the target may be raised to (0: the
+                         *   initial target); LB_DISK: size of the scratch
+                         *   file (0: 64MB) */
+    const char *path;   /* LB_DISK: directory to make the scratch file in,
+                         *   unlinked once open (NULL: /tmp), or a file to
+                         *   use instead, which is left in place */
+    size_t block_size;  /* LB_DISK: bytes per read or write (0: 32KB) */
+    enum lb_scope scope;
+};
+
+struct lb_stats {
+    double target;      /* as last set */
+    double achieved;    /* LB_CPU: percent, as for the target, and LB_DISK:
+                         *   bytes written per second, both over the last
+                         *   second; LB_MEM: bytes resident */
+    double elapsed;     /* seconds since lb_start() */
+    double cpu_seconds; /* CPU time used by the generator's workers */
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+};
+
+typedef struct lb_gen lb_gen;
+
+int lb_create(const struct lb_config *cfg, lb_gen **gen);
+int lb_start(lb_gen *gen);
+int lb_retarget(lb_gen *gen, double target);
+int lb_stats(lb_gen *gen, struct lb_stats *st);
+int lb_stop(lb_gen *gen);
+void lb_destroy(lb_gen *gen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOOKBUSY_H */